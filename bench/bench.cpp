@@ -0,0 +1,402 @@
+// bench.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+// Microbenchmarks for hot helpers. Each benchmark prints one JSON line with its
+// timings, so results of different runs / versions can be compared with a script.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "fpindex.h"
+#include "lookupparser.h"
+#include "mappedfile.h"
+#include "nameindex.h"
+#include "reporter.h"
+#include "scanner.h"
+#include "tag.h"
+#include "tagsession.h"
+#include "util.h"
+#include "version.h"
+
+#ifndef BENCH_DATA_DIR
+#define BENCH_DATA_DIR "tests"
+#endif
+
+struct Benchmark
+{
+  std::string name;
+  std::function<size_t()> func; // returns a value derived from the result to keep it alive
+};
+
+static double s_MinTimeSec = 0.5;
+static const int s_Samples = 5;
+static volatile size_t s_Sink = 0;
+
+static void Run(const Benchmark& p_Benchmark)
+{
+  // Calibrate iterations per sample so each sample runs for about min-time / samples
+  typedef std::chrono::steady_clock Clock;
+  const double sampleSec = s_MinTimeSec / s_Samples;
+  size_t iterations = 1;
+  while (true)
+  {
+    const Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+      s_Sink = s_Sink + p_Benchmark.func();
+    }
+
+    const double elapsedSec = std::chrono::duration<double>(Clock::now() - start).count();
+    if ((elapsedSec >= sampleSec) || (iterations >= (1u << 30)))
+    {
+      break;
+    }
+
+    iterations = (elapsedSec > 0) ? std::max(iterations * 2, static_cast<size_t>(
+                                               iterations * sampleSec * 1.2 / elapsedSec))
+                                  : iterations * 10;
+  }
+
+  std::vector<double> nsPerOp;
+  for (int sample = 0; sample < s_Samples; ++sample)
+  {
+    const Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+      s_Sink = s_Sink + p_Benchmark.func();
+    }
+
+    const double elapsedSec = std::chrono::duration<double>(Clock::now() - start).count();
+    nsPerOp.push_back(elapsedSec * 1e9 / iterations);
+  }
+
+  std::sort(nsPerOp.begin(), nsPerOp.end());
+  nlohmann::json result;
+  result["name"] = p_Benchmark.name;
+  result["version"] = Version::GetAppVersion();
+  result["iterations"] = iterations;
+  result["samples"] = s_Samples;
+  result["ns_per_op_min"] = nsPerOp.front();
+  result["ns_per_op_median"] = nsPerOp[nsPerOp.size() / 2];
+  result["ns_per_op_max"] = nsPerOp.back();
+  std::cout << result.dump() << std::endl;
+}
+
+static void MakeTree(const std::string& p_Dir, int p_Dirs, int p_FilesPerDir)
+{
+  for (int dir = 0; dir < p_Dirs; ++dir)
+  {
+    const std::string subDir = p_Dir + "/album" + std::to_string(dir);
+    std::filesystem::create_directories(subDir);
+    std::ofstream(subDir + "/cover.jpg");
+    for (int file = 0; file < p_FilesPerDir; ++file)
+    {
+      std::ofstream(subDir + "/track" + std::to_string(file) + ".mp3");
+    }
+  }
+}
+
+static void ShowHelp()
+{
+  std::cout <<
+    "Usage: idntag_bench [OPTIONS] [NAME...]\n"
+    "\n"
+    "Command-line options:\n"
+    "    -l, --list             list benchmarks\n"
+    "    -t, --min-time         seconds to run each benchmark (default 0.5)\n"
+    "    -h, --help             display help\n"
+    "    NAME                   benchmarks to run (default all)\n"
+    "\n";
+}
+
+int main(int argc, char* argv[])
+{
+  bool list = false;
+  std::vector<std::string> names;
+  std::vector<std::string> args(argv + 1, argv + argc);
+  for (auto it = args.begin(); it != args.end(); ++it)
+  {
+    const std::string& arg = *it;
+    const bool hasNextArg = (std::distance(it + 1, args.end()) > 0);
+    if ((arg == "-h") || (arg == "--help"))
+    {
+      ShowHelp();
+      return 0;
+    }
+    else if ((arg == "-l") || (arg == "--list"))
+    {
+      list = true;
+    }
+    else if (((arg == "-t") || (arg == "--min-time")) && hasNextArg)
+    {
+      ++it;
+      if (!Util::ToDouble(*it, s_MinTimeSec) || (s_MinTimeSec <= 0))
+      {
+        std::cerr << "ERROR: Invalid argument '" << *it << "'\n\n";
+        ShowHelp();
+        return 1;
+      }
+    }
+    else
+    {
+      names.push_back(arg);
+    }
+  }
+
+  // Scratch directory with sample files and generated trees
+  char tmpl[] = "/tmp/idntag_bench.XXXXXX";
+  if (mkdtemp(tmpl) == nullptr)
+  {
+    std::cerr << "ERROR: Failed to create temporary directory\n";
+    return 1;
+  }
+
+  const std::string tmpDir = tmpl;
+  const std::string songPath = tmpDir + "/song_en.mp3";
+  std::filesystem::copy_file(BENCH_DATA_DIR "/song_en.mp3", songPath);
+  const std::string paddedSongPath = tmpDir + "/song_padded.mp3";
+  std::filesystem::copy_file(BENCH_DATA_DIR "/song_en.mp3", paddedSongPath);
+  MakeTree(tmpDir + "/small", 10, 10);
+  MakeTree(tmpDir + "/large", 100, 20);
+  for (int i = 0; i < 3; ++i)
+  {
+    const std::string suffix = (i > 0) ? ("_" + std::to_string(i)) : "";
+    std::ofstream(tmpDir + "/Artist-Title" + suffix + ".mp3");
+  }
+
+  const std::string ascii = "Broke For Free - Night Owl (Original Mix) feat. Someone";
+  const std::string utf8 = "Dariusz Jackowski - Fryderyk Chopin: Nokturn cis-moll, Łódź 夜想曲";
+  const std::u32string utf32 = Util::Utf8ToUtf32(utf8);
+  int counter = 0;
+
+  const std::vector<std::string> stageNames = { "read", "fingerprint", "lookup", "write" };
+  const std::vector<double> stageSec = { 0.0012, 0.0451, 0.1205, 0.0023 };
+  const Reporter textReporter("%i : %r : %o", false /*p_Json*/, stageNames);
+  const Reporter jsonReporter("", true /*p_Json*/, stageNames);
+
+  // Random sub-fingerprints of 2 minute tracks, each tenth a copy of the one before it
+  std::mt19937 rng(1);
+  FpIndex fpIndex;
+  std::vector<std::vector<uint32_t>> fpTracks(1000, std::vector<uint32_t>(950));
+  for (size_t i = 0; i < fpTracks.size(); ++i)
+  {
+    for (size_t j = 0; j < fpTracks[i].size(); ++j)
+    {
+      fpTracks[i][j] = ((i % 10) == 9) ? fpTracks[i - 1][j] : static_cast<uint32_t>(rng());
+    }
+
+    fpIndex.Add(i, fpTracks[i]);
+  }
+
+  // Batch lookup response, with recordings and release groups like for popular tracks
+  nlohmann::json lookupFingerprints = nlohmann::json::array();
+  for (int i = 0; i < 10; ++i)
+  {
+    nlohmann::json results = nlohmann::json::array();
+    for (int j = 0; j < 20; ++j)
+    {
+      nlohmann::json releaseGroups = nlohmann::json::array();
+      for (int k = 0; k < 10; ++k)
+      {
+        releaseGroups.push_back({ { "id", "b5d5ba5b-3c18-3fd6-8a0c-28f4ac2fbb1d" },
+                                  { "title", "Release Group " + std::to_string(k) },
+                                  { "type", "Album" } });
+      }
+
+      nlohmann::json recording = { { "id", "2cc0ca5c-f1e6-4d9d-9e5c-53a4a1ef0c8e" },
+                                   { "title", "Title " + std::to_string(j) },
+                                   { "artists", { { { "name", "Artist" } } } },
+                                   { "releasegroups", releaseGroups } };
+      results.push_back({ { "id", "a3c4ba5d-60c5-4a47-9a50-5b4f2d5b9a1e" }, { "score", 0.9 },
+                          { "recordings", { recording } } });
+    }
+
+    lookupFingerprints.push_back({ { "index", i }, { "results", results } });
+  }
+
+  const std::string lookupResponse =
+    nlohmann::json({ { "status", "ok" }, { "fingerprints", lookupFingerprints } }).dump();
+
+  const std::vector<Benchmark> benchmarks =
+  {
+    { "sanitize_ascii", [&]() { return Tag::SanitizeFileName(ascii).size(); } },
+    { "sanitize_utf8", [&]() { return Tag::SanitizeFileName(utf8).size(); } },
+    { "utf8_to_utf32", [&]() { return Util::Utf8ToUtf32(utf8).size(); } },
+    { "utf32_to_utf8", [&]() { return Util::Utf32ToUtf8(utf32).size(); } },
+    { "make_path", [&]()
+      {
+        std::string artist = "Broke For Free";
+        std::string title = "Night Owl";
+        const std::string path = Tag::MakePath(songPath, artist, title);
+        NameIndex::Release(path);
+        return path.size();
+      }
+    },
+    { "make_path_collision", [&]()
+      {
+        std::string artist = "Artist";
+        std::string title = "Title";
+        const std::string path = Tag::MakePath(songPath, artist, title);
+        NameIndex::Release(path);
+        return path.size();
+      }
+    },
+    { "make_report", [&]()
+      {
+        const std::string newPath = tmpDir + "/Artist-Title.mp3";
+        std::string report;
+        Reporter::Record record;
+        record.filePath = songPath;
+        record.newFilePath = newPath;
+        record.result = true;
+        textReporter.Format(record, report);
+        return report.size();
+      }
+    },
+    { "make_report_jsonl", [&]()
+      {
+        const std::string newPath = tmpDir + "/Artist-Title.mp3";
+        std::string report;
+        Reporter::Record record;
+        record.filePath = songPath;
+        record.newFilePath = newPath;
+        record.artist = "Artist";
+        record.title = "Title";
+        record.result = true;
+        record.stageSec = &stageSec;
+        jsonReporter.Format(record, report);
+        return report.size();
+      }
+    },
+    { "tag_read", [&]()
+      {
+        std::string artist;
+        std::string title;
+        TagSession tagSession;
+        tagSession.Open(songPath, nullptr /*p_MappedFile*/);
+        tagSession.Read(artist, title);
+        return artist.size() + title.size();
+      }
+    },
+    { "tag_read_mapped", [&]()
+      {
+        std::string artist;
+        std::string title;
+        std::shared_ptr<MappedFile> mappedFile = std::make_shared<MappedFile>();
+        mappedFile->Open(songPath);
+        TagSession tagSession;
+        tagSession.Open(songPath, mappedFile);
+        tagSession.Read(artist, title);
+        return artist.size() + title.size();
+      }
+    },
+    { "tag_write", [&]()
+      {
+        // Alternate the title so every iteration saves
+        TagSession tagSession;
+        tagSession.Open(songPath, nullptr /*p_MappedFile*/);
+        tagSession.Write("Broke For Free", "Night Owl " + std::to_string(counter++ % 2));
+        return static_cast<size_t>(tagSession.Save(0 /*p_Padding*/));
+      }
+    },
+    { "tag_write_padded", [&]()
+      {
+        // Only the first iteration grows the tag, later ones fit in its padding
+        TagSession tagSession;
+        tagSession.Open(paddedSongPath, nullptr /*p_MappedFile*/);
+        tagSession.Write("Broke For Free", "Night Owl " + std::to_string(counter++ % 2));
+        return static_cast<size_t>(tagSession.Save(4096));
+      }
+    },
+    { "fp_bit_errors", [&]()
+      {
+        return FpIndex::CountBitErrors(fpTracks[0].data(), fpTracks[1].data(),
+                                       fpTracks[0].size());
+      }
+    },
+    { "fp_find_duplicates", [&]()
+      {
+        std::vector<std::vector<size_t>> groups;
+        fpIndex.FindDuplicates(0.8, groups);
+        return groups.size();
+      }
+    },
+    { "lookup_parse", [&]()
+      {
+        // Fed in chunks like received from curl
+        LookupParser parser(lookupFingerprints.size());
+        const size_t chunkSize = 16384;
+        for (size_t i = 0; i < lookupResponse.size(); i += chunkSize)
+        {
+          parser.Feed(lookupResponse.data() + i,
+                      std::min(chunkSize, lookupResponse.size() - i));
+        }
+
+        std::vector<std::vector<AcoustId::Match>> matches;
+        return parser.Finish(matches) ? matches.size() : 0;
+      }
+    },
+    { "lookup_parse_dom", [&]()
+      {
+        return nlohmann::json::parse(lookupResponse)["fingerprints"].size();
+      }
+    },
+    { "scan_small", [&]()
+      {
+        size_t count = 0;
+        Scanner scanner(1, { ".mp3" }, Scanner::Filter());
+        scanner.Scan({ tmpDir + "/small" }, [&](const std::string&) { ++count; });
+        return count;
+      }
+    },
+    { "scan_large", [&]()
+      {
+        size_t count = 0;
+        Scanner scanner(1, { ".mp3" }, Scanner::Filter());
+        scanner.Scan({ tmpDir + "/large" }, [&](const std::string&) { ++count; });
+        return count;
+      }
+    },
+    { "scan_large_parallel", [&]()
+      {
+        size_t count = 0;
+        Scanner scanner(4, { ".mp3" }, Scanner::Filter());
+        scanner.Scan({ tmpDir + "/large" }, [&](const std::string&) { ++count; });
+        return count;
+      }
+    },
+  };
+
+  for (const auto& benchmark : benchmarks)
+  {
+    if (list)
+    {
+      std::cout << benchmark.name << "\n";
+    }
+    else if (names.empty() ||
+             (std::find(names.begin(), names.end(), benchmark.name) != names.end()))
+    {
+      Run(benchmark);
+    }
+  }
+
+  std::filesystem::remove_all(tmpDir);
+
+  return 0;
+}
@@ -26,6 +26,7 @@ show_usage()
   echo "  build           - perform build"
   echo "  debug           - perform debug build"
   echo "  tests           - perform build and run tests"
+  echo "  bench           - perform build and run benchmarks"
   echo "  doc             - perform build and generate doc"
   echo "  install         - perform build and install"
   echo "  all             - perform deps, build, tests, doc and install"
@@ -39,6 +40,7 @@ DEPS="0"
 BUILD="0"
 DEBUG="0"
 TESTS="0"
+BENCH="0"
 DOC="0"
 INSTALL="0"
 SRC="0"
@@ -69,6 +71,11 @@ while [[ ${#} -gt 0 ]]; do
       TESTS="1"
       ;;
 
+    bench)
+      BUILD="1"
+      BENCH="1"
+      ;;
+
     doc)
       BUILD="1"
       DOC="1"
@@ -129,15 +136,15 @@ fi
 if [[ "${DEPS}" == "1" ]]; then
   if [ "${OS}" == "Linux" ]; then
     if [[ "${DISTRO}" == "Ubuntu" ]]; then
-      sudo apt update && sudo apt ${YES} install build-essential cmake pkg-config help2man libncurses-dev libncursesw5-dev libtag1-dev libcurl4-openssl-dev nlohmann-json3-dev libchromaprint-tools mp3info || exiterr "deps failed (${DISTRO}), exiting."
+      sudo apt update && sudo apt ${YES} install build-essential cmake pkg-config help2man libncurses-dev libncursesw5-dev libtag1-dev libcurl4-openssl-dev nlohmann-json3-dev libchromaprint-dev libchromaprint-tools libmpg123-dev mp3info || exiterr "deps failed (${DISTRO}), exiting."
     else
       exiterr "deps failed (unsupported linux distro ${DISTRO}), exiting."
     fi
   elif [ "${OS}" == "Darwin" ]; then
     if command -v brew &> /dev/null; then
-      HOMEBREW_NO_INSTALL_UPGRADE=1 HOMEBREW_NO_AUTO_UPDATE=1 brew install cmake pkg-config help2man ncurses libtag curl nlohmann-json chromaprint mp3info gsed || exiterr "deps failed (${OS} brew), exiting."
+      HOMEBREW_NO_INSTALL_UPGRADE=1 HOMEBREW_NO_AUTO_UPDATE=1 brew install cmake pkg-config help2man ncurses libtag curl nlohmann-json chromaprint mpg123 mp3info gsed || exiterr "deps failed (${OS} brew), exiting."
     elif command -v port &> /dev/null; then
-      sudo port -N install cmake help2man ncurses libtag curl nlohmann-json chromaprint mp3info gsed || exiterr "deps failed (${OS} port), exiting."
+      sudo port -N install cmake help2man ncurses libtag curl nlohmann-json chromaprint mpg123 mp3info gsed || exiterr "deps failed (${OS} port), exiting."
     else
       exiterr "deps failed (${OS} missing brew and port), exiting."
     fi
@@ -149,7 +156,7 @@ fi
 # src
 if [[ "${SRC}" == "1" ]]; then
   uncrustify --update-config-with-doc -c etc/uncrustify.cfg -o etc/uncrustify.cfg && \
-  uncrustify -c etc/uncrustify.cfg --replace --no-backup src/*.{cpp,h} || exiterr "unrustify failed, exiting."
+  uncrustify -c etc/uncrustify.cfg --replace --no-backup src/*.{cpp,h} bench/*.cpp || exiterr "unrustify failed, exiting."
 fi
 
 # bump
@@ -197,6 +204,11 @@ if [[ "${TESTS}" == "1" ]]; then
   cd build && ctest --output-on-failure && cd .. || exiterr "tests failed, exiting."
 fi
 
+# bench
+if [[ "${BENCH}" == "1" ]]; then
+  cd build && make -s ${MAKEARGS} idntag_bench && ./idntag_bench && cd .. || exiterr "bench failed, exiting."
+fi
+
 # doc
 if [[ "${DOC}" == "1" ]]; then
   if [[ -x "$(command -v help2man)" ]]; then
@@ -7,42 +7,146 @@
 
 #include "acoustid.h"
 
+#include <memory>
 #include <sstream>
 
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
 
+#include "fingerprinter.h"
+#include "fpcache.h"
+#include "httpclient.h"
 #include "log.h"
+#include "lookupbatcher.h"
+#include "lookupcache.h"
+#include "lookupparser.h"
+#include "offlinedb.h"
+#include "stats.h"
 #include "util.h"
 
+std::string AcoustId::m_Endpoint = AcoustId::DefaultEndpoint;
+
+void AcoustId::Init(const std::string& p_Endpoint)
+{
+  m_Endpoint = p_Endpoint;
+
+  // Global curl init is not thread-safe, so do it up front rather than lazily
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  HttpClient::Init();
+}
+
+void AcoustId::Cleanup()
+{
+  HttpClient::Cleanup();
+  curl_global_cleanup();
+}
+
 bool AcoustId::Identify(const std::string& p_FilePath, std::string& p_Artist,
                         std::string& p_Title)
 {
   Fingerprint fingerprint;
-  if (!GetFingerprint(p_FilePath, fingerprint))
+  if (!GetFingerprint(p_FilePath, nullptr /*p_MappedFile*/, fingerprint))
+  {
+    return false;
+  }
+
+  Match match;
+  if (!LookupMatch(fingerprint, match))
   {
     return false;
   }
 
+  p_Artist = match.artist;
+  p_Title = match.title;
+
+  return true;
+}
+
+bool AcoustId::LookupMatch(const Fingerprint& p_Fingerprint, Match& p_Match)
+{
   std::vector<Match> matches;
-  if (!LookupFingerprint(fingerprint, matches))
+  bool cached = false;
+  if (OfflineDb::IsEnabled())
+  {
+    // Local lookups take microseconds, so are neither batched nor cached
+    OfflineDb::Lookup(p_Fingerprint, matches);
+  }
+  else if (LookupCache::Get(p_Fingerprint, matches))
   {
+    Log::Debug("lookup cache hit");
+    Stats::AddCount("lookupcache.hit");
+    cached = true;
+  }
+  else
+  {
+    Stats::AddCount("lookupcache.miss");
+    if (!LookupBatcher::Lookup(p_Fingerprint, matches))
+    {
+      return false;
+    }
+
+    LookupCache::Set(p_Fingerprint, matches);
+  }
+
+  const bool found = GetBestMatch(matches, p_Match);
+  p_Match.cached = cached;
+  if (!found)
+  {
+    Log::Debug("acoustid no valid matches");
     return false;
   }
 
-  Match match;
-  if (!GetBestMatch(matches, match))
+  return true;
+}
+
+bool AcoustId::GetFingerprint(const std::string& p_FilePath, const MappedFile* p_MappedFile,
+                              Fingerprint& p_Fingerprint)
+{
+  FpCache::Key key;
+  const bool hasKey = FpCache::GetKey(p_FilePath, key);
+  if (hasKey && FpCache::Get(key, p_Fingerprint.fp, p_Fingerprint.duration_sec))
+  {
+    Log::Debug("fingerprint cache hit for %s", p_FilePath.c_str());
+    Stats::AddCount("fpcache.hit");
+    p_Fingerprint.cached = true;
+    return true;
+  }
+
+  Stats::AddCount("fpcache.miss");
+  p_Fingerprint.cached = false;
+
+  if (!CalcFingerprint(p_FilePath, p_MappedFile, p_Fingerprint))
   {
     return false;
   }
 
-  p_Artist = match.artist;
-  p_Title = match.title;
+  if (hasKey)
+  {
+    FpCache::Set(key, p_Fingerprint.fp, p_Fingerprint.duration_sec);
+  }
 
   return true;
 }
 
-bool AcoustId::GetFingerprint(const std::string& p_FilePath, Fingerprint& p_Fingerprint)
+bool AcoustId::CalcFingerprint(const std::string& p_FilePath, const MappedFile* p_MappedFile,
+                               Fingerprint& p_Fingerprint)
+{
+  Stats::Timer timer("fingerprint.calc");
+  if (Fingerprinter::IsAvailable())
+  {
+    if (Fingerprinter::Calculate(p_FilePath, p_MappedFile, p_Fingerprint.fp,
+                                 p_Fingerprint.duration_sec))
+    {
+      return true;
+    }
+
+    Log::Debug("built-in fingerprint failed, trying fpcalc");
+  }
+
+  return GetFingerprintFpcalc(p_FilePath, p_Fingerprint);
+}
+
+bool AcoustId::GetFingerprintFpcalc(const std::string& p_FilePath, Fingerprint& p_Fingerprint)
 {
   const std::string cmd = "fpcalc -json \"" + p_FilePath + "\"";
   const std::string jsonStr = Util::RunCommand(cmd);
@@ -67,94 +171,76 @@ bool AcoustId::GetFingerprint(const std::string& p_FilePath, Fingerprint& p_Fing
   return true;
 }
 
-bool AcoustId::LookupFingerprint(const Fingerprint& p_Fingerprint,
-                                 std::vector<Match>& p_Matches)
+bool AcoustId::LookupFingerprints(const std::vector<Fingerprint>& p_Fingerprints,
+                                  LookupResult& p_Result)
 {
-  static Util::RateLimiter rateLimiter(std::chrono::milliseconds(1000 / 3));
-  rateLimiter.Wait();
-
-  CURL* curl = curl_easy_init();
-  if (!curl)
+  if (p_Fingerprints.empty())
   {
-    Log::Debug("curl init failed");
     return false;
   }
 
-  std::string response;
-  curl_easy_setopt(curl, CURLOPT_URL, "https://api.acoustid.org/v2/lookup");
-  curl_easy_setopt(curl, CURLOPT_POST, 1L);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWriteString);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-
-  static std::string api_key = Util::StrFromHex("486536493641594B4E31");
-
-  std::ostringstream body;
-  body << "client=" << curl_easy_escape(curl, api_key.c_str(), 0)
-       << "&fingerprint=" << curl_easy_escape(curl, p_Fingerprint.fp.c_str(), 0)
-       << "&duration=" << p_Fingerprint.duration_sec
-       << "&meta=recordings+releasegroups+compress"
-       << "&format=json";
-  const std::string postfields = body.str();
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postfields.c_str());
-
-  CURLcode rc = curl_easy_perform(curl);
-  if (rc != CURLE_OK)
+  LookupParser parser(p_Fingerprints.size());
+  HttpClient::Response response;
+  HttpClient::Post(m_Endpoint, MakeLookupBody(p_Fingerprints), response,
+                   [&parser](const char* p_Data, size_t p_Size)
   {
-    Log::Debug("curl request failed");
-    curl_easy_cleanup(curl);
-    return false;
-  }
-
-  curl_easy_cleanup(curl);
+    return parser.Feed(p_Data, p_Size);
+  });
+  MakeLookupResult(response, parser, p_Result);
+  return p_Result.ok;
+}
 
-  if (response.empty())
+void AcoustId::LookupFingerprintsAsync(const std::vector<Fingerprint>& p_Fingerprints,
+                                       const LookupCallback& p_Callback)
+{
+  // The response is parsed as it is received, on the http client thread
+  std::shared_ptr<LookupParser> parser = std::make_shared<LookupParser>(p_Fingerprints.size());
+  HttpClient::PostAsync(m_Endpoint, MakeLookupBody(p_Fingerprints),
+                        [parser, p_Callback](const HttpClient::Response& p_Response)
   {
-    Log::Debug("curl response empty");
-    return false;
-  }
+    LookupResult result;
+    MakeLookupResult(p_Response, *parser, result);
+    p_Callback(result);
+  },
+                        [parser](const char* p_Data, size_t p_Size)
+  {
+    return parser->Feed(p_Data, p_Size);
+  });
+}
+
+std::string AcoustId::MakeLookupBody(const std::vector<Fingerprint>& p_Fingerprints)
+{
+  static std::string api_key = Util::StrFromHex("486536493641594B4E31");
 
-  nlohmann::json jsonDoc = nlohmann::json::parse(response);
-  if (!jsonDoc.contains("results") || jsonDoc["results"].empty())
+  // Multiple fingerprints are sent as indexed parameters in a single request
+  std::ostringstream body;
+  body << "client=" << Util::UrlEncode(api_key);
+  if (p_Fingerprints.size() == 1)
   {
-    Log::Debug("acoustid no results (%s)", response.c_str());
-    return false;
+    body << "&fingerprint=" << Util::UrlEncode(p_Fingerprints[0].fp)
+         << "&duration=" << p_Fingerprints[0].duration_sec;
   }
-
-  const nlohmann::json& results = jsonDoc["results"];
-  for (const nlohmann::json& result : results)
+  else
   {
-    Match match;
-
-    if (!result.contains("recordings") || result["recordings"].empty()) continue;
-
-    const nlohmann::json& recording = result["recordings"][0];
-
-    if (recording.contains("artists") && !recording["artists"].empty())
-    {
-      match.artist = recording["artists"][0].value("name", "");
-    }
-
-    if (recording.contains("title") && !recording["title"].empty())
-    {
-      match.title = recording["title"];
-    }
-
-    if (match.artist.empty() || match.title.empty())
+    for (size_t i = 0; i < p_Fingerprints.size(); ++i)
     {
-      continue;
+      body << "&fingerprint." << i << "=" << Util::UrlEncode(p_Fingerprints[i].fp)
+           << "&duration." << i << "=" << p_Fingerprints[i].duration_sec;
     }
-
-    match.score = result.value("score", 0.0);
-    p_Matches.push_back(match);
   }
 
-  if (p_Matches.empty())
-  {
-    Log::Debug("acoustid no valid matches");
-    return false;
-  }
+  body << "&meta=recordings+releasegroups+compress"
+       << "&format=json";
+  return body.str();
+}
 
-  return true;
+void AcoustId::MakeLookupResult(const HttpClient::Response& p_Response, LookupParser& p_Parser,
+                                LookupResult& p_Result)
+{
+  // Too Many Requests and Service Unavailable both mean back off and try again later
+  p_Result.throttled = (p_Response.status == 429) || (p_Response.status == 503);
+  p_Result.retryAfterSec = p_Response.retryAfterSec;
+  p_Result.ok = p_Response.ok && p_Parser.Finish(p_Result.matches);
 }
 
 bool AcoustId::GetBestMatch(const std::vector<Match>& p_Matches, Match& p_BestMatch)
@@ -175,10 +261,3 @@ bool AcoustId::GetBestMatch(const std::vector<Match>& p_Matches, Match& p_BestMa
 
   return true;
 }
-
-size_t AcoustId::CurlWriteString(void* ptr, size_t size, size_t nmemb, void* userdata)
-{
-  auto* s = static_cast<std::string*>(userdata);
-  s->append(static_cast<char*>(ptr), size*nmemb);
-  return size*nmemb;
-}
@@ -7,16 +7,23 @@
 
 #pragma once
 
+#include <functional>
 #include <string>
 #include <vector>
 
+#include "httpclient.h"
+
+class LookupParser;
+class MappedFile;
+
 class AcoustId
 {
-private:
+public:
   struct Fingerprint
   {
     std::string fp;
     int duration_sec = 0;
+    bool cached = false;
   };
 
   struct Match
@@ -24,16 +31,43 @@ private:
     std::string title;
     std::string artist;
     double score = 0.0;
+    bool cached = false;
   };
 
+  struct LookupResult
+  {
+    bool ok = false;
+    bool throttled = false;
+    long retryAfterSec = 0;
+    std::vector<std::vector<Match>> matches;
+  };
+
+  typedef std::function<void(const LookupResult&)> LookupCallback;
+
+  static constexpr const char* DefaultEndpoint = "https://api.acoustid.org/v2/lookup";
+
 public:
+  static void Init(const std::string& p_Endpoint);
+  static void Cleanup();
   static bool Identify(const std::string& p_FilePath, std::string& p_Artist,
                        std::string& p_Title);
+  static bool GetFingerprint(const std::string& p_FilePath, const MappedFile* p_MappedFile,
+                             Fingerprint& p_Fingerprint);
+  static bool LookupMatch(const Fingerprint& p_Fingerprint, Match& p_Match);
+  static bool LookupFingerprints(const std::vector<Fingerprint>& p_Fingerprints,
+                                 LookupResult& p_Result);
+  static void LookupFingerprintsAsync(const std::vector<Fingerprint>& p_Fingerprints,
+                                      const LookupCallback& p_Callback);
 
 private:
-  static bool GetFingerprint(const std::string& p_FilePath, Fingerprint& p_Fingerprint);
-  static bool LookupFingerprint(const Fingerprint& p_Fingerprint,
-                                std::vector<Match>& p_Matches);
+  static bool CalcFingerprint(const std::string& p_FilePath, const MappedFile* p_MappedFile,
+                              Fingerprint& p_Fingerprint);
+  static bool GetFingerprintFpcalc(const std::string& p_FilePath, Fingerprint& p_Fingerprint);
+  static std::string MakeLookupBody(const std::vector<Fingerprint>& p_Fingerprints);
+  static void MakeLookupResult(const HttpClient::Response& p_Response, LookupParser& p_Parser,
+                               LookupResult& p_Result);
   static bool GetBestMatch(const std::vector<Match>& p_Matches, Match& p_BestMatch);
-  static size_t CurlWriteString(void* ptr, size_t size, size_t nmemb, void* userdata);
+
+private:
+  static std::string m_Endpoint;
 };
@@ -0,0 +1,73 @@
+// boundedqueue.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template<typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t p_Capacity)
+    : m_Capacity(p_Capacity)
+  {
+  }
+
+  // Blocks while the queue is full
+  void Push(T p_Item)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_NotFullCond.wait(lock, [&]() { return m_Items.size() < m_Capacity; });
+    m_Items.push_back(std::move(p_Item));
+    m_NotEmptyCond.notify_one();
+  }
+
+  // Blocks while the queue is empty, returns false once closed and drained
+  bool Pop(T& p_Item)
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_NotEmptyCond.wait(lock, [&]() { return !m_Items.empty() || m_Closed; });
+    if (m_Items.empty())
+    {
+      return false;
+    }
+
+    p_Item = std::move(m_Items.front());
+    m_Items.pop_front();
+    m_NotFullCond.notify_one();
+    return true;
+  }
+
+  void Close()
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Closed = true;
+    m_NotEmptyCond.notify_all();
+  }
+
+  size_t Size()
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Items.size();
+  }
+
+  size_t Capacity() const
+  {
+    return m_Capacity;
+  }
+
+private:
+  const size_t m_Capacity;
+  bool m_Closed = false;
+  std::deque<T> m_Items;
+  std::mutex m_Mutex;
+  std::condition_variable m_NotEmptyCond;
+  std::condition_variable m_NotFullCond;
+};
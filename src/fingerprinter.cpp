@@ -0,0 +1,212 @@
+// fingerprinter.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "fingerprinter.h"
+
+#ifdef HAVE_CHROMAPRINT
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#include <sys/types.h>
+
+#include <chromaprint.h>
+#include <mpg123.h>
+#endif
+
+#include "log.h"
+#include "mappedfile.h"
+
+#ifdef HAVE_CHROMAPRINT
+// Same amount of audio as fpcalc uses by default
+static const int s_MaxLengthSec = 120;
+
+// Read position within a mapped file, used as mpg123 reader handle
+struct MappedReader
+{
+  const char* data = nullptr;
+  size_t size = 0;
+  size_t pos = 0;
+};
+
+static ssize_t MappedRead(void* p_Handle, void* p_Buf, size_t p_Count)
+{
+  MappedReader* reader = static_cast<MappedReader*>(p_Handle);
+  const size_t count = std::min(p_Count, reader->size - reader->pos);
+  memcpy(p_Buf, reader->data + reader->pos, count);
+  reader->pos += count;
+  return static_cast<ssize_t>(count);
+}
+
+static off_t MappedSeek(void* p_Handle, off_t p_Offset, int p_Whence)
+{
+  MappedReader* reader = static_cast<MappedReader*>(p_Handle);
+  off_t base = 0;
+  if (p_Whence == SEEK_CUR)
+  {
+    base = static_cast<off_t>(reader->pos);
+  }
+  else if (p_Whence == SEEK_END)
+  {
+    base = static_cast<off_t>(reader->size);
+  }
+
+  const off_t pos = base + p_Offset;
+  if ((pos < 0) || (pos > static_cast<off_t>(reader->size)))
+  {
+    return -1;
+  }
+
+  reader->pos = static_cast<size_t>(pos);
+  return pos;
+}
+#endif
+
+bool Fingerprinter::IsAvailable()
+{
+#ifdef HAVE_CHROMAPRINT
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Fingerprinter::Calculate(const std::string& p_FilePath, const MappedFile* p_MappedFile,
+                              std::string& p_Fingerprint, int& p_DurationSec)
+{
+#ifdef HAVE_CHROMAPRINT
+  static std::once_flag initFlag;
+  std::call_once(initFlag, []() { mpg123_init(); });
+
+  int err = MPG123_OK;
+  mpg123_handle* mh = mpg123_new(nullptr, &err);
+  if (mh == nullptr)
+  {
+    Log::Debug("mpg123 init failed (%s)", mpg123_plain_strerror(err));
+    return false;
+  }
+
+  mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0.0);
+
+  // Decode straight from the mapping shared with the tag reader when available
+  MappedReader reader;
+  int rc = MPG123_OK;
+  if (p_MappedFile != nullptr)
+  {
+    reader.data = p_MappedFile->GetData();
+    reader.size = p_MappedFile->GetSize();
+    rc = mpg123_replace_reader_handle(mh, MappedRead, MappedSeek, nullptr);
+    if (rc == MPG123_OK)
+    {
+      rc = mpg123_open_handle(mh, &reader);
+    }
+  }
+  else
+  {
+    rc = mpg123_open(mh, p_FilePath.c_str());
+  }
+
+  if (rc != MPG123_OK)
+  {
+    Log::Debug("mpg123 open failed (%s)", mpg123_strerror(mh));
+    mpg123_delete(mh);
+    return false;
+  }
+
+  // Lock output format to interleaved 16-bit samples as expected by chromaprint
+  long rate = 0;
+  int channels = 0;
+  int encoding = 0;
+  if ((mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK) ||
+      (rate <= 0) || (channels <= 0))
+  {
+    Log::Debug("mpg123 get format failed (%s)", mpg123_strerror(mh));
+    mpg123_close(mh);
+    mpg123_delete(mh);
+    return false;
+  }
+
+  mpg123_format_none(mh);
+  mpg123_format(mh, rate, channels, MPG123_ENC_SIGNED_16);
+
+  ChromaprintContext* ctx = chromaprint_new(CHROMAPRINT_ALGORITHM_DEFAULT);
+  chromaprint_start(ctx, static_cast<int>(rate), channels);
+
+  const int64_t maxFrames = static_cast<int64_t>(rate) * s_MaxLengthSec;
+  int64_t frames = 0;
+  bool decodeDone = false;
+  bool decodeOk = true;
+  unsigned char buf[32768];
+  while (frames < maxFrames)
+  {
+    size_t done = 0;
+    rc = mpg123_read(mh, buf, sizeof(buf), &done);
+    if (done > 0)
+    {
+      const int samples = static_cast<int>(done / sizeof(int16_t));
+      chromaprint_feed(ctx, reinterpret_cast<const int16_t*>(buf), samples);
+      frames += samples / channels;
+    }
+
+    if (rc == MPG123_DONE)
+    {
+      decodeDone = true;
+      break;
+    }
+    else if ((rc != MPG123_OK) && (rc != MPG123_NEW_FORMAT))
+    {
+      Log::Debug("mpg123 decode failed (%s)", mpg123_strerror(mh));
+      decodeOk = false;
+      break;
+    }
+  }
+
+  // Duration of the whole file, like fpcalc reports it, not only the decoded part
+  const off_t totalFrames = mpg123_length(mh);
+  int durationSec = 0;
+  if (totalFrames > 0)
+  {
+    durationSec = static_cast<int>(totalFrames / rate);
+  }
+  else if (decodeDone)
+  {
+    durationSec = static_cast<int>(frames / rate);
+  }
+
+  mpg123_close(mh);
+  mpg123_delete(mh);
+
+  std::string fingerprint;
+  char* fp = nullptr;
+  if (decodeOk && (frames > 0) && chromaprint_finish(ctx) &&
+      chromaprint_get_fingerprint(ctx, &fp) && (fp != nullptr))
+  {
+    fingerprint = fp;
+    chromaprint_dealloc(fp);
+  }
+
+  chromaprint_free(ctx);
+
+  if (fingerprint.empty() || (durationSec == 0))
+  {
+    Log::Debug("fingerprint failed for %s", p_FilePath.c_str());
+    return false;
+  }
+
+  p_Fingerprint = fingerprint;
+  p_DurationSec = durationSec;
+
+  return true;
+#else
+  (void)p_FilePath;
+  (void)p_MappedFile;
+  (void)p_Fingerprint;
+  (void)p_DurationSec;
+  return false;
+#endif
+}
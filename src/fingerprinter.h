@@ -0,0 +1,20 @@
+// fingerprinter.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <string>
+
+class MappedFile;
+
+class Fingerprinter
+{
+public:
+  static bool IsAvailable();
+  static bool Calculate(const std::string& p_FilePath, const MappedFile* p_MappedFile,
+                        std::string& p_Fingerprint, int& p_DurationSec);
+};
@@ -0,0 +1,244 @@
+// fpcache.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "fpcache.h"
+
+#include <cstring>
+#include <functional>
+
+#include <sys/stat.h>
+
+#include "log.h"
+
+static const char s_Magic[8] = { 'I', 'D', 'N', 'T', 'F', 'P', 'C', '1' };
+
+// On-disk record header, followed by the fingerprint string
+struct Record
+{
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtimeNs;
+  int32_t durationSec;
+  uint32_t length;
+};
+
+std::mutex FpCache::m_Mutex;
+std::string FpCache::m_Path;
+RecordLog FpCache::m_Log("fingerprint cache", s_Magic);
+std::unordered_map<FpCache::Key, FpCache::Entry, FpCache::KeyHash> FpCache::m_Entries;
+
+bool FpCache::Key::operator==(const Key& p_Other) const
+{
+  return (dev == p_Other.dev) && (ino == p_Other.ino) && (size == p_Other.size) &&
+         (mtimeNs == p_Other.mtimeNs);
+}
+
+size_t FpCache::KeyHash::operator()(const Key& p_Key) const
+{
+  size_t hash = std::hash<uint64_t>()(p_Key.ino);
+  hash ^= std::hash<uint64_t>()(p_Key.dev) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+  hash ^= std::hash<uint64_t>()(p_Key.size) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+  hash ^= std::hash<int64_t>()(p_Key.mtimeNs) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+void FpCache::Init(const std::string& p_Path)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Path = p_Path;
+  if (!Load())
+  {
+    Log::Debug("fingerprint cache disabled");
+    m_Entries.clear();
+    return;
+  }
+
+  const auto writer = []()
+  {
+    for (const auto& entry : m_Entries)
+    {
+      if (!Append(entry.first, GetFingerprint(entry.second), entry.second.durationSec))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  };
+
+  // Records move when compacted, so the rewritten log is loaded again
+  if (m_Log.NeedsCompact(m_Entries.size()) && m_Log.Compact(writer))
+  {
+    m_Entries.clear();
+    if (!Load())
+    {
+      m_Entries.clear();
+    }
+  }
+}
+
+void FpCache::Cleanup()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Log.Close();
+  m_Entries.clear();
+}
+
+bool FpCache::GetKey(const std::string& p_FilePath, Key& p_Key)
+{
+  struct stat st;
+  if (stat(p_FilePath.c_str(), &st) != 0)
+  {
+    return false;
+  }
+
+  p_Key.dev = static_cast<uint64_t>(st.st_dev);
+  p_Key.ino = static_cast<uint64_t>(st.st_ino);
+  p_Key.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+  p_Key.mtimeNs = (static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000) +
+                  st.st_mtimespec.tv_nsec;
+#else
+  p_Key.mtimeNs = (static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000) + st.st_mtim.tv_nsec;
+#endif
+
+  return true;
+}
+
+bool FpCache::Get(const Key& p_Key, std::string& p_Fingerprint, int& p_DurationSec)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto it = m_Entries.find(p_Key);
+  if (it == m_Entries.end())
+  {
+    return false;
+  }
+
+  p_Fingerprint = GetFingerprint(it->second);
+  p_DurationSec = it->second.durationSec;
+  return true;
+}
+
+void FpCache::Set(const Key& p_Key, const std::string& p_Fingerprint, int p_DurationSec)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (!m_Log.IsOpen())
+  {
+    return;
+  }
+
+  if (!Append(p_Key, p_Fingerprint, p_DurationSec))
+  {
+    return;
+  }
+
+  Entry entry;
+  entry.length = static_cast<uint32_t>(p_Fingerprint.size());
+  entry.durationSec = p_DurationSec;
+  entry.fingerprint = p_Fingerprint;
+  auto it = m_Entries.find(p_Key);
+  if (it != m_Entries.end())
+  {
+    it->second = entry;
+    m_Log.AddSuperseded();
+  }
+  else
+  {
+    m_Entries.emplace(p_Key, entry);
+  }
+}
+
+void FpCache::Rekey(const Key& p_OldKey, const Key& p_NewKey)
+{
+  if (p_OldKey == p_NewKey)
+  {
+    return;
+  }
+
+  std::string fingerprint;
+  int durationSec = 0;
+  if (Get(p_OldKey, fingerprint, durationSec))
+  {
+    Set(p_NewKey, fingerprint, durationSec);
+  }
+}
+
+bool FpCache::Load()
+{
+  if (!m_Log.Open(m_Path, false /*p_Truncate*/, ReadRecord))
+  {
+    return false;
+  }
+
+  Log::Debug("fingerprint cache loaded %zu entries", m_Entries.size());
+  return true;
+}
+
+size_t FpCache::ReadRecord(const char* p_Data, size_t p_Size, size_t p_Offset)
+{
+  if (p_Size < sizeof(Record))
+  {
+    return 0;
+  }
+
+  Record record;
+  memcpy(&record, p_Data, sizeof(Record));
+  if ((sizeof(Record) + record.length) > p_Size)
+  {
+    return 0;
+  }
+
+  Key key;
+  key.dev = record.dev;
+  key.ino = record.ino;
+  key.size = record.size;
+  key.mtimeNs = record.mtimeNs;
+
+  Entry entry;
+  entry.offset = p_Offset + sizeof(Record);
+  entry.length = record.length;
+  entry.durationSec = record.durationSec;
+
+  auto it = m_Entries.find(key);
+  if (it != m_Entries.end())
+  {
+    it->second = entry;
+    m_Log.AddSuperseded();
+  }
+  else
+  {
+    m_Entries.emplace(key, entry);
+  }
+
+  return sizeof(Record) + record.length;
+}
+
+bool FpCache::Append(const Key& p_Key, const std::string& p_Fingerprint, int p_DurationSec)
+{
+  Record record;
+  record.dev = p_Key.dev;
+  record.ino = p_Key.ino;
+  record.size = p_Key.size;
+  record.mtimeNs = p_Key.mtimeNs;
+  record.durationSec = p_DurationSec;
+  record.length = static_cast<uint32_t>(p_Fingerprint.size());
+
+  std::string data(reinterpret_cast<const char*>(&record), sizeof(Record));
+  data.append(p_Fingerprint);
+  return m_Log.Append(data.data(), data.size());
+}
+
+std::string FpCache::GetFingerprint(const Entry& p_Entry)
+{
+  if (!p_Entry.fingerprint.empty() || (m_Log.GetData() == nullptr))
+  {
+    return p_Entry.fingerprint;
+  }
+
+  return std::string(m_Log.GetData() + p_Entry.offset, p_Entry.length);
+}
@@ -0,0 +1,64 @@
+// fpcache.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "recordlog.h"
+
+// Persistent fingerprint cache keyed by file identity. The cache file is an append-only
+// record log which is memory-mapped on open, with fingerprints read from it on demand.
+class FpCache
+{
+public:
+  struct Key
+  {
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+
+    bool operator==(const Key& p_Other) const;
+  };
+
+public:
+  static void Init(const std::string& p_Path);
+  static void Cleanup();
+  static bool GetKey(const std::string& p_FilePath, Key& p_Key);
+  static bool Get(const Key& p_Key, std::string& p_Fingerprint, int& p_DurationSec);
+  static void Set(const Key& p_Key, const std::string& p_Fingerprint, int p_DurationSec);
+  static void Rekey(const Key& p_OldKey, const Key& p_NewKey);
+
+private:
+  struct Entry
+  {
+    size_t offset = 0;
+    uint32_t length = 0;
+    int32_t durationSec = 0;
+    std::string fingerprint;
+  };
+
+  struct KeyHash
+  {
+    size_t operator()(const Key& p_Key) const;
+  };
+
+  static bool Load();
+  static size_t ReadRecord(const char* p_Data, size_t p_Size, size_t p_Offset);
+  static bool Append(const Key& p_Key, const std::string& p_Fingerprint, int p_DurationSec);
+  static std::string GetFingerprint(const Entry& p_Entry);
+
+private:
+  static std::mutex m_Mutex;
+  static std::string m_Path;
+  static RecordLog m_Log;
+  static std::unordered_map<Key, Entry, KeyHash> m_Entries;
+};
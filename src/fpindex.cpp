@@ -0,0 +1,430 @@
+// fpindex.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "fpindex.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FPINDEX_AVX2
+#include <immintrin.h>
+#endif
+
+#include "log.h"
+#include "stats.h"
+
+// Sub-fingerprints are bucketed by their upper 24 bits, which survive re-encoding far more
+// often than all 32, and buckets shared by very many tracks (e.g. silence) are ignored
+static const int s_KeyShift = 8;
+static const size_t s_MaxBucketSize = 512;
+
+// Only the start of each track is indexed and queried, which allows for offsets of about
+// 15 seconds (8 sub-fingerprints per second) while keeping the index small
+static const size_t s_IndexValues = 128;
+static const size_t s_QueryValues = 256;
+
+// Candidates need hits at the same offset in several buckets and an overlap of 5 seconds
+static const size_t s_MinVotes = 3;
+static const size_t s_MinOverlap = 40;
+
+// Tracks are kept and compared by about their first minute, which leaves over 30 seconds of
+// overlap at the largest offset queried, at half the memory of two minute fingerprints
+static const size_t s_MaxValues = 512;
+static_assert(s_MaxValues >= s_QueryValues + s_MinOverlap, "too few values kept for overlap");
+
+// Index entries pack bucket key, track and position into 24, 32 and 8 bits, so that sorting
+// them groups each bucket by track, and a directory on the upper 16 key bits narrows lookups
+static const int s_KeyBits = 32 - s_KeyShift;
+static const int s_TrackShift = 8;
+static const int s_EntryKeyShift = 40;
+static const int s_DirBits = 16;
+static_assert(s_KeyBits <= 24, "bucket key does not fit index entry");
+static_assert(s_IndexValues <= 256, "position does not fit index entry");
+
+static int GetBase64Value(char p_Char)
+{
+  // Chromaprint uses the url-safe alphabet, the standard one is accepted as well
+  if ((p_Char >= 'A') && (p_Char <= 'Z')) return p_Char - 'A';
+  if ((p_Char >= 'a') && (p_Char <= 'z')) return p_Char - 'a' + 26;
+  if ((p_Char >= '0') && (p_Char <= '9')) return p_Char - '0' + 52;
+  if ((p_Char == '-') || (p_Char == '+')) return 62;
+  if ((p_Char == '_') || (p_Char == '/')) return 63;
+  return -1;
+}
+
+static unsigned GetPacked(const std::vector<uint8_t>& p_Bytes, size_t p_Offset, unsigned p_Width,
+                          size_t p_Index)
+{
+  // Values of up to 5 bits are packed least significant bit first, so span at most two bytes
+  const size_t bit = p_Index * p_Width;
+  const size_t pos = p_Offset + (bit / 8);
+  unsigned window = p_Bytes[pos];
+  if ((pos + 1) < p_Bytes.size())
+  {
+    window |= static_cast<unsigned>(p_Bytes[pos + 1]) << 8;
+  }
+
+  return (window >> (bit % 8)) & ((1u << p_Width) - 1);
+}
+
+static size_t CountBitErrorsScalar(const uint32_t* p_Values, const uint32_t* p_OtherValues,
+                                   size_t p_Count)
+{
+  size_t errors = 0;
+  for (size_t i = 0; i < p_Count; ++i)
+  {
+    errors += static_cast<size_t>(__builtin_popcount(p_Values[i] ^ p_OtherValues[i]));
+  }
+
+  return errors;
+}
+
+#ifdef FPINDEX_AVX2
+__attribute__((target("avx2")))
+static size_t CountBitErrorsAvx2(const uint32_t* p_Values, const uint32_t* p_OtherValues,
+                                 size_t p_Count)
+{
+  // Population count of 8 values at a time by nibble table lookups, summed per 64 bits
+  const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowMask = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sums = zero;
+  size_t i = 0;
+  for (; (i + 8) <= p_Count; i += 8)
+  {
+    const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_Values + i));
+    const __m256i otherValues =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_OtherValues + i));
+    const __m256i diff = _mm256_xor_si256(values, otherValues);
+    const __m256i low = _mm256_and_si256(diff, lowMask);
+    const __m256i high = _mm256_and_si256(_mm256_srli_epi16(diff, 4), lowMask);
+    const __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, low),
+                                           _mm256_shuffle_epi8(table, high));
+    sums = _mm256_add_epi64(sums, _mm256_sad_epu8(counts, zero));
+  }
+
+  const size_t errors = static_cast<size_t>(_mm256_extract_epi64(sums, 0)) +
+                        static_cast<size_t>(_mm256_extract_epi64(sums, 1)) +
+                        static_cast<size_t>(_mm256_extract_epi64(sums, 2)) +
+                        static_cast<size_t>(_mm256_extract_epi64(sums, 3));
+  return errors + CountBitErrorsScalar(p_Values + i, p_OtherValues + i, p_Count - i);
+}
+#endif
+
+typedef size_t (*CountBitErrorsFunc)(const uint32_t*, const uint32_t*, size_t);
+
+static CountBitErrorsFunc GetCountBitErrorsFunc()
+{
+#ifdef FPINDEX_AVX2
+  if (__builtin_cpu_supports("avx2"))
+  {
+    Log::Debug("fingerprint compare using avx2");
+    return CountBitErrorsAvx2;
+  }
+#endif
+
+  return CountBitErrorsScalar;
+}
+
+static size_t FindRoot(std::vector<size_t>& p_Parents, size_t p_Index)
+{
+  while (p_Parents[p_Index] != p_Index)
+  {
+    p_Parents[p_Index] = p_Parents[p_Parents[p_Index]];
+    p_Index = p_Parents[p_Index];
+  }
+
+  return p_Index;
+}
+
+FpIndex::FpIndex()
+{
+}
+
+void FpIndex::Add(size_t p_Id, const std::vector<uint32_t>& p_Values)
+{
+  Track track;
+  track.id = p_Id;
+  track.offset = m_Values.size();
+  track.count = std::min(p_Values.size(), s_MaxValues);
+  m_Values.insert(m_Values.end(), p_Values.begin(), p_Values.begin() + track.count);
+  m_Tracks.push_back(track);
+}
+
+void FpIndex::FindDuplicates(double p_MinSimilarity,
+                             std::vector<std::vector<size_t>>& p_Groups) const
+{
+  Stats::Timer timer("dup.search");
+  std::vector<uint64_t> entries;
+  for (size_t i = 0; i < m_Tracks.size(); ++i)
+  {
+    AddEntries(&m_Values[m_Tracks[i].offset], m_Tracks[i].count, i, entries);
+  }
+
+  std::sort(entries.begin(), entries.end());
+  std::vector<uint64_t> directory;
+  MakeDirectory(entries, directory);
+
+  // Each track is matched against the tracks before it, so every pair is compared once
+  std::vector<size_t> parents(m_Tracks.size());
+  std::iota(parents.begin(), parents.end(), 0);
+  std::vector<uint64_t> votes;
+  std::vector<Candidate> candidates;
+  for (size_t i = 0; i < m_Tracks.size(); ++i)
+  {
+    const Track& track = m_Tracks[i];
+    FindCandidates(entries.data(), directory.data(), &m_Values[track.offset], track.count, i,
+                   votes, candidates);
+    for (const Candidate& candidate : candidates)
+    {
+      if (FindRoot(parents, i) == FindRoot(parents, candidate.track))
+      {
+        continue;
+      }
+
+      Stats::AddCount("dup.candidates");
+      const Track& other = m_Tracks[candidate.track];
+      const double similarity = GetSimilarity(&m_Values[track.offset], track.count,
+                                              &m_Values[other.offset], other.count,
+                                              candidate.offset);
+      if (similarity >= p_MinSimilarity)
+      {
+        Log::Debug("duplicate %zu %zu offset %d similarity %.3f", other.id, track.id,
+                   candidate.offset, similarity);
+        Stats::AddCount("dup.matches");
+        parents[FindRoot(parents, i)] = FindRoot(parents, candidate.track);
+      }
+    }
+  }
+
+  std::map<size_t, std::vector<size_t>> groups;
+  for (size_t i = 0; i < m_Tracks.size(); ++i)
+  {
+    groups[FindRoot(parents, i)].push_back(m_Tracks[i].id);
+  }
+
+  p_Groups.clear();
+  for (auto& group : groups)
+  {
+    if (group.second.size() > 1)
+    {
+      std::sort(group.second.begin(), group.second.end());
+      p_Groups.push_back(std::move(group.second));
+    }
+  }
+
+  std::sort(p_Groups.begin(), p_Groups.end());
+}
+
+bool FpIndex::Decode(const std::string& p_Fingerprint, std::vector<uint32_t>& p_Values)
+{
+  std::vector<uint8_t> bytes;
+  bytes.reserve((p_Fingerprint.size() * 3) / 4);
+  uint32_t accumulator = 0;
+  int accumulatorBits = 0;
+  for (const char ch : p_Fingerprint)
+  {
+    const int value = GetBase64Value(ch);
+    if (value < 0)
+    {
+      return false;
+    }
+
+    accumulator = (accumulator << 6) | static_cast<uint32_t>(value);
+    accumulatorBits += 6;
+    if (accumulatorBits >= 8)
+    {
+      accumulatorBits -= 8;
+      bytes.push_back(static_cast<uint8_t>(accumulator >> accumulatorBits));
+      accumulator &= (1u << accumulatorBits) - 1;
+    }
+  }
+
+  // Header of algorithm and value count, then 3-bit deltas between set bits of each value
+  // terminated by zero, with 7 marking a delta continued in the 5-bit exceptions after them
+  if (bytes.size() < 4)
+  {
+    return false;
+  }
+
+  const size_t count = (static_cast<size_t>(bytes[1]) << 16) |
+                       (static_cast<size_t>(bytes[2]) << 8) | static_cast<size_t>(bytes[3]);
+  const size_t normalOffset = 4;
+  const size_t maxNormal = ((bytes.size() - normalOffset) * 8) / 3;
+  std::vector<uint8_t> normals;
+  size_t found = 0;
+  size_t exceptionCount = 0;
+  for (size_t i = 0; (i < maxNormal) && (found < count); ++i)
+  {
+    const unsigned normal = GetPacked(bytes, normalOffset, 3, i);
+    normals.push_back(static_cast<uint8_t>(normal));
+    found += (normal == 0) ? 1 : 0;
+    exceptionCount += (normal == 7) ? 1 : 0;
+  }
+
+  const size_t exceptionOffset = normalOffset + ((normals.size() * 3) + 7) / 8;
+  if ((count == 0) || (found != count) ||
+      (bytes.size() < (exceptionOffset + ((exceptionCount * 5) + 7) / 8)))
+  {
+    return false;
+  }
+
+  p_Values.assign(count, 0);
+  size_t index = 0;
+  size_t exceptionIndex = 0;
+  uint32_t value = 0;
+  unsigned lastBit = 0;
+  for (const uint8_t normal : normals)
+  {
+    if (normal == 0)
+    {
+      p_Values[index] = (index > 0) ? (value ^ p_Values[index - 1]) : value;
+      value = 0;
+      lastBit = 0;
+      ++index;
+      continue;
+    }
+
+    unsigned bit = normal;
+    if (normal == 7)
+    {
+      bit += GetPacked(bytes, exceptionOffset, 5, exceptionIndex++);
+    }
+
+    bit += lastBit;
+    if (bit > 32)
+    {
+      return false;
+    }
+
+    lastBit = bit;
+    value |= 1u << (bit - 1);
+  }
+
+  return true;
+}
+
+size_t FpIndex::CountBitErrors(const uint32_t* p_Values, const uint32_t* p_OtherValues,
+                               size_t p_Count)
+{
+  static const CountBitErrorsFunc func = GetCountBitErrorsFunc();
+  return func(p_Values, p_OtherValues, p_Count);
+}
+
+double FpIndex::GetSimilarity(const uint32_t* p_Values, size_t p_Count,
+                             const uint32_t* p_OtherValues, size_t p_OtherCount, int p_Offset)
+{
+  // A positive offset means the track starts later within its file than the other
+  const size_t start = (p_Offset > 0) ? static_cast<size_t>(p_Offset) : 0;
+  const size_t otherStart = (p_Offset < 0) ? static_cast<size_t>(-p_Offset) : 0;
+  if ((start >= p_Count) || (otherStart >= p_OtherCount))
+  {
+    return 0.0;
+  }
+
+  const size_t overlap = std::min(p_Count - start, p_OtherCount - otherStart);
+  if (overlap < std::min(s_MinOverlap, std::min(p_Count, p_OtherCount)))
+  {
+    return 0.0;
+  }
+
+  const size_t errors = CountBitErrors(p_Values + start, p_OtherValues + otherStart, overlap);
+  return 1.0 - (static_cast<double>(errors) / (32.0 * static_cast<double>(overlap)));
+}
+
+void FpIndex::AddEntries(const uint32_t* p_Values, size_t p_Count, size_t p_Track,
+                         std::vector<uint64_t>& p_Entries)
+{
+  const size_t count = std::min(p_Count, s_IndexValues);
+  for (size_t pos = 0; pos < count; ++pos)
+  {
+    const uint64_t key = p_Values[pos] >> s_KeyShift;
+    p_Entries.push_back((key << s_EntryKeyShift) |
+                        (static_cast<uint64_t>(p_Track) << s_TrackShift) | pos);
+  }
+}
+
+size_t FpIndex::GetDirectorySize()
+{
+  return (static_cast<size_t>(1) << s_DirBits) + 1;
+}
+
+void FpIndex::MakeDirectory(const std::vector<uint64_t>& p_Entries,
+                            std::vector<uint64_t>& p_Directory)
+{
+  // Start of the entries of each directory slot, in entries sorted by value
+  p_Directory.assign(GetDirectorySize(), p_Entries.size());
+  for (size_t i = p_Entries.size(); i > 0; --i)
+  {
+    p_Directory[p_Entries[i - 1] >> (s_EntryKeyShift + s_KeyBits - s_DirBits)] = i - 1;
+  }
+
+  for (size_t dir = p_Directory.size() - 1; dir > 0; --dir)
+  {
+    p_Directory[dir - 1] = std::min(p_Directory[dir - 1], p_Directory[dir]);
+  }
+}
+
+void FpIndex::FindCandidates(const uint64_t* p_Entries, const uint64_t* p_Directory,
+                             const uint32_t* p_Values, size_t p_Count, size_t p_MaxTrack,
+                             std::vector<uint64_t>& p_Votes,
+                             std::vector<Candidate>& p_Candidates)
+{
+  p_Votes.clear();
+  p_Candidates.clear();
+  const size_t count = std::min(p_Count, s_QueryValues);
+  for (size_t pos = 0; pos < count; ++pos)
+  {
+    const uint64_t key = p_Values[pos] >> s_KeyShift;
+    const size_t dir = static_cast<size_t>(key >> (s_KeyBits - s_DirBits));
+    const uint64_t* dirEnd = p_Entries + p_Directory[dir + 1];
+    const uint64_t* begin = std::lower_bound(p_Entries + p_Directory[dir], dirEnd,
+                                             key << s_EntryKeyShift);
+    const uint64_t* end = std::lower_bound(begin, dirEnd, (key + 1) << s_EntryKeyShift);
+    if (static_cast<size_t>(end - begin) > s_MaxBucketSize)
+    {
+      continue;
+    }
+
+    // Entries of a bucket are in track order, so the ones of earlier tracks come first
+    for (const uint64_t* it = begin; it != end; ++it)
+    {
+      const uint64_t track = (*it >> s_TrackShift) & 0xffffffff;
+      if (track >= p_MaxTrack)
+      {
+        break;
+      }
+
+      // Offset of the values relative to the track, biased to be non-negative
+      const uint64_t trackPos = *it & 0xff;
+      const uint64_t offset = pos + s_IndexValues - trackPos;
+      p_Votes.push_back((track << 32) | offset);
+    }
+  }
+
+  // Count votes per track and offset as runs of equal values
+  std::sort(p_Votes.begin(), p_Votes.end());
+  for (size_t begin = 0, end = 0; begin < p_Votes.size(); begin = end)
+  {
+    while ((end < p_Votes.size()) && (p_Votes[end] == p_Votes[begin]))
+    {
+      ++end;
+    }
+
+    if ((end - begin) >= s_MinVotes)
+    {
+      Candidate candidate;
+      candidate.track = static_cast<size_t>(p_Votes[begin] >> 32);
+      candidate.offset = static_cast<int>(p_Votes[begin] & 0xffffffff) -
+                         static_cast<int>(s_IndexValues);
+      p_Candidates.push_back(candidate);
+    }
+  }
+}
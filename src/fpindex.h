@@ -0,0 +1,61 @@
+// fpindex.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Index of decoded Chromaprint fingerprints for finding near-duplicate recordings. Tracks
+// are bucketed by the upper bits of their sub-fingerprints, and only tracks sharing enough
+// buckets at a consistent time offset are compared bit by bit. The static functions work on
+// plain arrays, so that the same index layout can be stored in and used from a file.
+class FpIndex
+{
+public:
+  struct Candidate
+  {
+    size_t track = 0;
+    int offset = 0;
+  };
+
+public:
+  FpIndex();
+
+  void Add(size_t p_Id, const std::vector<uint32_t>& p_Values);
+  void FindDuplicates(double p_MinSimilarity, std::vector<std::vector<size_t>>& p_Groups) const;
+
+  static bool Decode(const std::string& p_Fingerprint, std::vector<uint32_t>& p_Values);
+  static size_t CountBitErrors(const uint32_t* p_Values, const uint32_t* p_OtherValues,
+                               size_t p_Count);
+  static double GetSimilarity(const uint32_t* p_Values, size_t p_Count,
+                              const uint32_t* p_OtherValues, size_t p_OtherCount, int p_Offset);
+
+  static void AddEntries(const uint32_t* p_Values, size_t p_Count, size_t p_Track,
+                         std::vector<uint64_t>& p_Entries);
+  static size_t GetDirectorySize();
+  static void MakeDirectory(const std::vector<uint64_t>& p_Entries,
+                            std::vector<uint64_t>& p_Directory);
+  static void FindCandidates(const uint64_t* p_Entries, const uint64_t* p_Directory,
+                             const uint32_t* p_Values, size_t p_Count, size_t p_MaxTrack,
+                             std::vector<uint64_t>& p_Votes,
+                             std::vector<Candidate>& p_Candidates);
+
+private:
+  struct Track
+  {
+    size_t id = 0;
+    size_t offset = 0;
+    size_t count = 0;
+  };
+
+private:
+  std::vector<Track> m_Tracks;
+  std::vector<uint32_t> m_Values;
+};
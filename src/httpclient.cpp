@@ -0,0 +1,224 @@
+// httpclient.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "httpclient.h"
+
+#include <future>
+#include <set>
+
+#include <curl/curl.h>
+
+#include "log.h"
+#include "stats.h"
+
+void* HttpClient::m_Multi = nullptr;
+bool HttpClient::m_Running = false;
+std::thread HttpClient::m_Thread;
+std::mutex HttpClient::m_Mutex;
+std::deque<HttpClient::Transfer*> HttpClient::m_Pending;
+
+void HttpClient::Init()
+{
+  CURLM* multi = curl_multi_init();
+  if (multi == nullptr)
+  {
+    Log::Debug("curl multi init failed");
+    return;
+  }
+
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 4L);
+
+  m_Multi = multi;
+  m_Running = true;
+  m_Thread = std::thread(&HttpClient::Process);
+}
+
+void HttpClient::Cleanup()
+{
+  if (m_Thread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Running = false;
+    }
+
+    curl_multi_wakeup(static_cast<CURLM*>(m_Multi));
+    m_Thread.join();
+  }
+
+  if (m_Multi != nullptr)
+  {
+    curl_multi_cleanup(static_cast<CURLM*>(m_Multi));
+    m_Multi = nullptr;
+  }
+}
+
+void HttpClient::PostAsync(const std::string& p_Url, const std::string& p_Body,
+                           const Callback& p_Callback, const DataCallback& p_DataCallback)
+{
+  CURL* curl = curl_easy_init();
+  if (curl == nullptr)
+  {
+    Log::Debug("curl init failed");
+    p_Callback(Response());
+    return;
+  }
+
+  Transfer* transfer = new Transfer();
+  transfer->curl = curl;
+  transfer->callback = p_Callback;
+  transfer->dataCallback = p_DataCallback;
+
+  curl_easy_setopt(curl, CURLOPT_URL, p_Url.c_str());
+  curl_easy_setopt(curl, CURLOPT_POST, 1L);
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(p_Body.size()));
+  curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, p_Body.c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWrite);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 120L);
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Running)
+    {
+      m_Pending.push_back(transfer);
+      transfer = nullptr;
+    }
+  }
+
+  if (transfer != nullptr)
+  {
+    Log::Debug("http client not running");
+    curl_easy_cleanup(curl);
+    delete transfer;
+    p_Callback(Response());
+    return;
+  }
+
+  curl_multi_wakeup(static_cast<CURLM*>(m_Multi));
+}
+
+bool HttpClient::Post(const std::string& p_Url, const std::string& p_Body, Response& p_Response,
+                      const DataCallback& p_DataCallback)
+{
+  std::promise<Response> promise;
+  std::future<Response> future = promise.get_future();
+  PostAsync(p_Url, p_Body, [&promise](const Response& p_Resp) { promise.set_value(p_Resp); },
+            p_DataCallback);
+  p_Response = future.get();
+  return p_Response.ok;
+}
+
+void HttpClient::Process()
+{
+  CURLM* multi = static_cast<CURLM*>(m_Multi);
+  std::set<Transfer*> active;
+  std::deque<Transfer*> pending;
+  while (true)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      pending.swap(m_Pending);
+      if (!m_Running)
+      {
+        break;
+      }
+    }
+
+    for (Transfer* transfer : pending)
+    {
+      curl_multi_add_handle(multi, static_cast<CURL*>(transfer->curl));
+      active.insert(transfer);
+    }
+
+    pending.clear();
+
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    int msgs = 0;
+    while (CURLMsg* msg = curl_multi_info_read(multi, &msgs))
+    {
+      if (msg->msg != CURLMSG_DONE)
+      {
+        continue;
+      }
+
+      CURL* curl = msg->easy_handle;
+      Transfer* transfer = nullptr;
+      curl_easy_getinfo(curl, CURLINFO_PRIVATE, &transfer);
+
+      Response& response = transfer->response;
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+      curl_off_t retryAfter = 0;
+      curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retryAfter);
+      response.retryAfterSec = static_cast<long>(retryAfter);
+      response.ok = (msg->data.result == CURLE_OK) && (response.status == 200);
+      if (msg->data.result != CURLE_OK)
+      {
+        Log::Debug("curl request failed (%s)", curl_easy_strerror(msg->data.result));
+        Stats::AddCount("http.failed");
+      }
+      else
+      {
+        if (response.status != 200)
+        {
+          Log::Debug("http status %ld", response.status);
+        }
+
+        Stats::AddCount("http.status." + std::to_string(response.status));
+      }
+
+      curl_off_t totalUs = 0;
+      curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &totalUs);
+      Stats::AddTime("http.request", totalUs / 1e6);
+
+      curl_multi_remove_handle(multi, curl);
+      curl_easy_cleanup(curl);
+      active.erase(transfer);
+      transfer->callback(response);
+      delete transfer;
+    }
+
+    curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+  }
+
+  // Fail transfers still in progress or not yet started when shutting down
+  for (Transfer* transfer : active)
+  {
+    curl_multi_remove_handle(multi, static_cast<CURL*>(transfer->curl));
+    pending.push_back(transfer);
+  }
+
+  for (Transfer* transfer : pending)
+  {
+    curl_easy_cleanup(static_cast<CURL*>(transfer->curl));
+    transfer->callback(Response());
+    delete transfer;
+  }
+}
+
+size_t HttpClient::CurlWrite(void* ptr, size_t size, size_t nmemb, void* userdata)
+{
+  // Returning less than the size received makes curl abort the transfer
+  auto* transfer = static_cast<Transfer*>(userdata);
+  if (transfer->dataCallback)
+  {
+    return transfer->dataCallback(static_cast<char*>(ptr), size*nmemb) ? size*nmemb : 0;
+  }
+
+  transfer->response.body.append(static_cast<char*>(ptr), size*nmemb);
+  return size*nmemb;
+}
@@ -0,0 +1,61 @@
+// httpclient.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Asynchronous HTTP client running all transfers on a single curl multi handle, so that
+// connections are kept alive and reused, and multiplexed over HTTP/2 where available.
+class HttpClient
+{
+public:
+  struct Response
+  {
+    bool ok = false;
+    long status = 0;
+    long retryAfterSec = 0;
+    std::string body;
+  };
+
+  typedef std::function<void(const Response&)> Callback;
+
+  // Receives the body as it arrives instead of it being collected, returns false to abort
+  typedef std::function<bool(const char*, size_t)> DataCallback;
+
+public:
+  static void Init();
+  static void Cleanup();
+  static void PostAsync(const std::string& p_Url, const std::string& p_Body,
+                        const Callback& p_Callback,
+                        const DataCallback& p_DataCallback = DataCallback());
+  static bool Post(const std::string& p_Url, const std::string& p_Body,
+                   Response& p_Response, const DataCallback& p_DataCallback = DataCallback());
+
+private:
+  struct Transfer
+  {
+    void* curl = nullptr;
+    Response response;
+    Callback callback;
+    DataCallback dataCallback;
+  };
+
+  static void Process();
+  static size_t CurlWrite(void* ptr, size_t size, size_t nmemb, void* userdata);
+
+private:
+  static void* m_Multi;
+  static bool m_Running;
+  static std::thread m_Thread;
+  static std::mutex m_Mutex;
+  static std::deque<Transfer*> m_Pending;
+};
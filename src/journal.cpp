@@ -0,0 +1,131 @@
+// journal.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "journal.h"
+
+#include <cstring>
+
+#include "log.h"
+#include "stats.h"
+
+static const char s_Magic[8] = { 'I', 'D', 'N', 'T', 'J', 'R', 'N', '1' };
+
+// Completed files are on disk at most this long before a crash could lose them
+static const std::chrono::seconds s_SyncInterval(1);
+
+// On-disk record header, followed by the file path and new file path
+struct Record
+{
+  uint32_t result;
+  uint32_t pathLength;
+  uint32_t newPathLength;
+};
+
+std::mutex Journal::m_Mutex;
+std::string Journal::m_Path;
+RecordLog Journal::m_Log("journal", s_Magic);
+std::chrono::steady_clock::time_point Journal::m_SyncTime;
+std::unordered_set<std::string_view> Journal::m_Done;
+
+bool Journal::Init(const std::string& p_Path, bool p_Resume)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Path = p_Path;
+  if (!Load(p_Resume))
+  {
+    Log::Debug("journal disabled");
+    m_Done.clear();
+    return false;
+  }
+
+  m_SyncTime = std::chrono::steady_clock::now();
+  return true;
+}
+
+void Journal::Cleanup()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Log.Sync();
+  m_Done.clear();
+  m_Log.Close();
+}
+
+bool Journal::IsDone(const std::string& p_FilePath)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Done.find(p_FilePath) != m_Done.end();
+}
+
+void Journal::Add(const std::string& p_FilePath, const std::string& p_NewFilePath, bool p_Result)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (!m_Log.IsOpen())
+  {
+    return;
+  }
+
+  Record record;
+  record.result = p_Result ? 1 : 0;
+  record.pathLength = static_cast<uint32_t>(p_FilePath.size());
+  record.newPathLength = static_cast<uint32_t>(p_NewFilePath.size());
+
+  std::string data(reinterpret_cast<const char*>(&record), sizeof(Record));
+  data.append(p_FilePath);
+  data.append(p_NewFilePath);
+  if (!m_Log.Append(data.data(), data.size()))
+  {
+    return;
+  }
+
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if ((now - m_SyncTime) >= s_SyncInterval)
+  {
+    Stats::Timer timer("journal.sync");
+    m_Log.Sync();
+    m_SyncTime = now;
+  }
+}
+
+bool Journal::Load(bool p_Resume)
+{
+  // Failed files are retried, so only successful ones are indexed
+  size_t count = 0;
+  const auto reader = [&count](const char* p_Data, size_t p_Size, size_t p_Offset) -> size_t
+  {
+    (void)p_Offset;
+    if (p_Size < sizeof(Record))
+    {
+      return 0;
+    }
+
+    Record record;
+    memcpy(&record, p_Data, sizeof(Record));
+    const size_t length = sizeof(Record) + record.pathLength + record.newPathLength;
+    if (length > p_Size)
+    {
+      return 0;
+    }
+
+    if (record.result != 0)
+    {
+      const char* path = p_Data + sizeof(Record);
+      m_Done.emplace(path, record.pathLength);
+      m_Done.emplace(path + record.pathLength, record.newPathLength);
+    }
+
+    ++count;
+    return length;
+  };
+
+  if (!m_Log.Open(m_Path, !p_Resume /*p_Truncate*/, reader))
+  {
+    return false;
+  }
+
+  Log::Debug("journal loaded %zu records", count);
+  return true;
+}
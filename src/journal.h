@@ -0,0 +1,38 @@
+// journal.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include "recordlog.h"
+
+// Append-only journal of completed files, synced to disk periodically, so that an interrupted
+// run can be resumed. Replay memory-maps the journal and indexes the paths of files processed
+// successfully, both by their original and new name, without copying them.
+class Journal
+{
+public:
+  static bool Init(const std::string& p_Path, bool p_Resume);
+  static void Cleanup();
+  static bool IsDone(const std::string& p_FilePath);
+  static void Add(const std::string& p_FilePath, const std::string& p_NewFilePath, bool p_Result);
+
+private:
+  static bool Load(bool p_Resume);
+
+private:
+  static std::mutex m_Mutex;
+  static std::string m_Path;
+  static RecordLog m_Log;
+  static std::chrono::steady_clock::time_point m_SyncTime;
+  static std::unordered_set<std::string_view> m_Done;
+};
@@ -7,8 +7,10 @@
 
 #include "log.h"
 
+#include <algorithm>
 #include <cstdarg>
 #include <cstdio>
+#include <vector>
 
 bool Log::m_Verbose = false;
 
@@ -16,11 +18,17 @@ void Log::Debug(const char* p_Format, ...)
 {
   if (m_Verbose)
   {
+    // Format into one buffer so lines from parallel jobs do not interleave
     va_list vaList;
+    va_list vaListCopy;
     va_start(vaList, p_Format);
-    vprintf(p_Format, vaList);
+    va_copy(vaListCopy, vaList);
+    const int len = vsnprintf(nullptr, 0, p_Format, vaList);
     va_end(vaList);
-    printf("\n");
+    std::vector<char> buf(std::max(len, 0) + 1);
+    vsnprintf(buf.data(), buf.size(), p_Format, vaListCopy);
+    va_end(vaListCopy);
+    printf("%s\n", buf.data());
   }
 }
 
@@ -28,3 +36,8 @@ void Log::SetVerbose(bool p_Verbose)
 {
   m_Verbose = p_Verbose;
 }
+
+bool Log::GetVerbose()
+{
+  return m_Verbose;
+}
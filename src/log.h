@@ -12,6 +12,7 @@ class Log
 public:
   static void Debug(const char* p_Format, ...);
   static void SetVerbose(bool p_Verbose);
+  static bool GetVerbose();
 
 private:
   static bool m_Verbose;
@@ -0,0 +1,188 @@
+// lookupbatcher.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "lookupbatcher.h"
+
+#include "log.h"
+#include "stats.h"
+
+static const int s_MaxAttempts = 5;
+
+Util::RateLimiter LookupBatcher::m_RateLimiter(3.0, 1.0);
+int LookupBatcher::m_BatchSize = 1;
+bool LookupBatcher::m_Running = false;
+std::thread LookupBatcher::m_Thread;
+std::mutex LookupBatcher::m_Mutex;
+std::condition_variable LookupBatcher::m_RequestCond;
+std::condition_variable LookupBatcher::m_DoneCond;
+std::deque<LookupBatcher::Request*> LookupBatcher::m_Requests;
+
+void LookupBatcher::Init(int p_BatchSize, double p_Rate, double p_Burst)
+{
+  m_RateLimiter.SetRate(p_Rate, p_Burst);
+  m_BatchSize = p_BatchSize;
+  if (m_BatchSize > 1)
+  {
+    m_Running = true;
+    m_Thread = std::thread(&LookupBatcher::Process);
+  }
+}
+
+void LookupBatcher::Cleanup()
+{
+  if (m_Thread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Running = false;
+    }
+
+    m_RequestCond.notify_all();
+    m_Thread.join();
+  }
+}
+
+bool LookupBatcher::Lookup(const AcoustId::Fingerprint& p_Fingerprint,
+                           std::vector<AcoustId::Match>& p_Matches)
+{
+  if (!m_Running)
+  {
+    for (int attempt = 1; attempt <= s_MaxAttempts; ++attempt)
+    {
+      {
+        Stats::Timer timer("lookup.ratelimit");
+        m_RateLimiter.Wait();
+      }
+
+      AcoustId::LookupResult result;
+      if (AcoustId::LookupFingerprints({ p_Fingerprint }, result))
+      {
+        m_RateLimiter.OnSuccess();
+        p_Matches = result.matches.at(0);
+        return true;
+      }
+
+      if (!result.throttled)
+      {
+        break;
+      }
+
+      Log::Debug("acoustid throttled, retry after %ld sec", result.retryAfterSec);
+      Stats::AddCount("lookup.throttled");
+      m_RateLimiter.OnThrottle(result.retryAfterSec);
+    }
+
+    return false;
+  }
+
+  Request request;
+  request.fingerprint = &p_Fingerprint;
+  request.matches = &p_Matches;
+
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_Requests.push_back(&request);
+  m_RequestCond.notify_one();
+  m_DoneCond.wait(lock, [&]() { return request.done; });
+
+  return request.result;
+}
+
+void LookupBatcher::Process()
+{
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_RequestCond.wait(lock, []() { return !m_Requests.empty() || !m_Running; });
+      if (m_Requests.empty() && !m_Running)
+      {
+        break;
+      }
+    }
+
+    // Requests keep accumulating while waiting for the rate limiter
+    {
+      Stats::Timer timer("lookup.ratelimit");
+      m_RateLimiter.Wait();
+    }
+
+    std::vector<Request*> batch;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      while (!m_Requests.empty() && (static_cast<int>(batch.size()) < m_BatchSize))
+      {
+        batch.push_back(m_Requests.front());
+        m_Requests.pop_front();
+      }
+    }
+
+    if (batch.empty())
+    {
+      continue;
+    }
+
+    std::vector<AcoustId::Fingerprint> fingerprints;
+    for (Request* request : batch)
+    {
+      fingerprints.push_back(*request->fingerprint);
+      ++request->attempts;
+    }
+
+    // Do not wait for the response, so that further batches can be in flight meanwhile
+    Log::Debug("acoustid lookup batch of %zu", batch.size());
+    Stats::AddCount("lookup.batches");
+    Stats::AddCount("lookup.fingerprints", batch.size());
+    auto onResult = [batch](const AcoustId::LookupResult& p_Result)
+    {
+      Complete(batch, p_Result);
+    };
+    AcoustId::LookupFingerprintsAsync(fingerprints, onResult);
+  }
+}
+
+void LookupBatcher::Complete(const std::vector<Request*>& p_Batch,
+                             const AcoustId::LookupResult& p_Result)
+{
+  if (p_Result.ok)
+  {
+    m_RateLimiter.OnSuccess();
+  }
+  else if (p_Result.throttled)
+  {
+    Log::Debug("acoustid throttled, retry after %ld sec", p_Result.retryAfterSec);
+    Stats::AddCount("lookup.throttled");
+    m_RateLimiter.OnThrottle(p_Result.retryAfterSec);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    // Throttled requests are put back first in queue to be retried
+    std::vector<Request*> retries;
+    for (size_t i = 0; i < p_Batch.size(); ++i)
+    {
+      if (!p_Result.ok && p_Result.throttled && (p_Batch[i]->attempts < s_MaxAttempts))
+      {
+        retries.push_back(p_Batch[i]);
+        continue;
+      }
+
+      p_Batch[i]->result = p_Result.ok;
+      if (p_Result.ok)
+      {
+        *p_Batch[i]->matches = p_Result.matches.at(i);
+      }
+
+      p_Batch[i]->done = true;
+    }
+
+    m_Requests.insert(m_Requests.begin(), retries.begin(), retries.end());
+  }
+
+  m_RequestCond.notify_one();
+  m_DoneCond.notify_all();
+}
@@ -0,0 +1,53 @@
+// lookupbatcher.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "acoustid.h"
+#include "util.h"
+
+// Rate-limited AcoustID lookups. Fingerprints submitted by concurrent callers while a
+// request is pending are collected and sent together in a single batch request. Only a
+// batch size of one makes callers look up directly, whatever the number of jobs.
+class LookupBatcher
+{
+public:
+  static void Init(int p_BatchSize, double p_Rate, double p_Burst);
+  static void Cleanup();
+  static bool Lookup(const AcoustId::Fingerprint& p_Fingerprint,
+                     std::vector<AcoustId::Match>& p_Matches);
+
+private:
+  struct Request
+  {
+    const AcoustId::Fingerprint* fingerprint = nullptr;
+    std::vector<AcoustId::Match>* matches = nullptr;
+    int attempts = 0;
+    bool done = false;
+    bool result = false;
+  };
+
+  static void Process();
+  static void Complete(const std::vector<Request*>& p_Batch,
+                       const AcoustId::LookupResult& p_Result);
+
+private:
+  static Util::RateLimiter m_RateLimiter;
+  static int m_BatchSize;
+  static bool m_Running;
+  static std::thread m_Thread;
+  static std::mutex m_Mutex;
+  static std::condition_variable m_RequestCond;
+  static std::condition_variable m_DoneCond;
+  static std::deque<Request*> m_Requests;
+};
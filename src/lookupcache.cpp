@@ -0,0 +1,259 @@
+// lookupcache.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "lookupcache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include <nlohmann/json.hpp>
+
+#include "log.h"
+
+// Negative entries first expire after an hour, then back off up to the regular ttl
+static const int64_t s_MissTtlSec = 60 * 60;
+
+std::mutex LookupCache::m_Mutex;
+std::string LookupCache::m_Path;
+int64_t LookupCache::m_TtlSec = 0;
+bool LookupCache::m_Enabled = false;
+size_t LookupCache::m_DeadCount = 0;
+std::unordered_map<std::string, LookupCache::Entry> LookupCache::m_Entries;
+
+static int64_t GetTimeNow()
+{
+  return std::chrono::duration_cast<std::chrono::seconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool IsValidEntry(const nlohmann::json& p_JsonDoc)
+{
+  // Lines are checked up front, as accessing fields of other types throws
+  if (!p_JsonDoc.is_object() || !p_JsonDoc.value("key", nlohmann::json()).is_string() ||
+      !p_JsonDoc.value("time", nlohmann::json()).is_number() ||
+      !p_JsonDoc.value("misses", nlohmann::json()).is_number() ||
+      !p_JsonDoc.value("matches", nlohmann::json()).is_array())
+  {
+    return false;
+  }
+
+  for (const nlohmann::json& jsonMatch : p_JsonDoc["matches"])
+  {
+    if (!jsonMatch.is_object() || !jsonMatch.value("artist", nlohmann::json()).is_string() ||
+        !jsonMatch.value("title", nlohmann::json()).is_string() ||
+        !jsonMatch.value("score", nlohmann::json()).is_number())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void LookupCache::Init(const std::string& p_Path, int64_t p_TtlSec)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Path = p_Path;
+  m_TtlSec = p_TtlSec;
+  m_Enabled = true;
+  Load();
+
+  // Rewrite the log when mostly made up of superseded or expired entries
+  if ((m_DeadCount > 1024) && (m_DeadCount > m_Entries.size()))
+  {
+    Compact();
+  }
+}
+
+void LookupCache::Cleanup()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Enabled = false;
+  m_Entries.clear();
+  m_DeadCount = 0;
+}
+
+bool LookupCache::Get(const AcoustId::Fingerprint& p_Fingerprint,
+                      std::vector<AcoustId::Match>& p_Matches)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (!m_Enabled)
+  {
+    return false;
+  }
+
+  auto it = m_Entries.find(GetKey(p_Fingerprint));
+  if ((it == m_Entries.end()) || (GetTimeNow() >= GetExpiry(it->second)))
+  {
+    return false;
+  }
+
+  p_Matches = it->second.matches;
+  return true;
+}
+
+void LookupCache::Set(const AcoustId::Fingerprint& p_Fingerprint,
+                      const std::vector<AcoustId::Match>& p_Matches)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (!m_Enabled)
+  {
+    return;
+  }
+
+  const std::string key = GetKey(p_Fingerprint);
+  Entry entry;
+  entry.time = GetTimeNow();
+  entry.matches = p_Matches;
+
+  auto it = m_Entries.find(key);
+  if (it != m_Entries.end())
+  {
+    if (p_Matches.empty() && it->second.matches.empty())
+    {
+      entry.misses = it->second.misses + 1;
+    }
+
+    ++m_DeadCount;
+  }
+
+  std::ofstream file(m_Path, std::ios::app);
+  file << Serialize(key, entry) << "\n";
+  if (!file)
+  {
+    Log::Debug("lookup cache write failed");
+  }
+
+  m_Entries[key] = entry;
+}
+
+std::string LookupCache::GetKey(const AcoustId::Fingerprint& p_Fingerprint)
+{
+  // 64-bit FNV-1a of the fingerprint, avoids storing multi-kilobyte fingerprints as keys
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const char c : p_Fingerprint.fp)
+  {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ULL;
+  }
+
+  char key[64];
+  snprintf(key, sizeof(key), "%016llx-%zu-%d", static_cast<unsigned long long>(hash),
+           p_Fingerprint.fp.size(), p_Fingerprint.duration_sec);
+  return key;
+}
+
+int64_t LookupCache::GetExpiry(const Entry& p_Entry)
+{
+  if (!p_Entry.matches.empty())
+  {
+    return p_Entry.time + m_TtlSec;
+  }
+
+  const int shift = std::min(p_Entry.misses, 30);
+  return p_Entry.time + std::min(s_MissTtlSec << shift, m_TtlSec);
+}
+
+void LookupCache::Load()
+{
+  std::ifstream file(m_Path);
+  if (!file)
+  {
+    return;
+  }
+
+  const int64_t now = GetTimeNow();
+  std::string line;
+  while (std::getline(file, line))
+  {
+    nlohmann::json jsonDoc = nlohmann::json::parse(line, nullptr, false /*allow_exceptions*/);
+    if (jsonDoc.is_discarded() || !IsValidEntry(jsonDoc))
+    {
+      Log::Debug("lookup cache skipped invalid entry");
+      continue;
+    }
+
+    Entry entry;
+    entry.time = jsonDoc["time"].get<int64_t>();
+    entry.misses = jsonDoc["misses"].get<int>();
+    for (const nlohmann::json& jsonMatch : jsonDoc["matches"])
+    {
+      AcoustId::Match match;
+      match.artist = jsonMatch["artist"].get<std::string>();
+      match.title = jsonMatch["title"].get<std::string>();
+      match.score = jsonMatch["score"].get<double>();
+      entry.matches.push_back(match);
+    }
+
+    const std::string key = jsonDoc["key"].get<std::string>();
+    if (m_Entries.count(key) > 0)
+    {
+      ++m_DeadCount;
+    }
+
+    // Expired misses are kept for the ttl so that their backoff carries over between runs
+    const int64_t expiry = entry.matches.empty() ? (entry.time + m_TtlSec) : GetExpiry(entry);
+    if (now >= expiry)
+    {
+      ++m_DeadCount;
+      m_Entries.erase(key);
+      continue;
+    }
+
+    m_Entries[key] = entry;
+  }
+
+  Log::Debug("lookup cache loaded %zu entries", m_Entries.size());
+}
+
+void LookupCache::Compact()
+{
+  const std::string tmpPath = m_Path + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::trunc);
+    for (const auto& keyEntry : m_Entries)
+    {
+      file << Serialize(keyEntry.first, keyEntry.second) << "\n";
+    }
+
+    if (!file)
+    {
+      std::remove(tmpPath.c_str());
+      return;
+    }
+  }
+
+  if (std::rename(tmpPath.c_str(), m_Path.c_str()) != 0)
+  {
+    std::remove(tmpPath.c_str());
+    return;
+  }
+
+  Log::Debug("lookup cache compacted %zu entries", m_DeadCount);
+  m_DeadCount = 0;
+}
+
+std::string LookupCache::Serialize(const std::string& p_Key, const Entry& p_Entry)
+{
+  nlohmann::json jsonDoc;
+  jsonDoc["key"] = p_Key;
+  jsonDoc["time"] = p_Entry.time;
+  jsonDoc["misses"] = p_Entry.misses;
+  jsonDoc["matches"] = nlohmann::json::array();
+  for (const auto& match : p_Entry.matches)
+  {
+    nlohmann::json jsonMatch;
+    jsonMatch["artist"] = match.artist;
+    jsonMatch["title"] = match.title;
+    jsonMatch["score"] = match.score;
+    jsonDoc["matches"].push_back(jsonMatch);
+  }
+
+  return jsonDoc.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+}
@@ -0,0 +1,53 @@
+// lookupcache.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "acoustid.h"
+
+// Persistent cache of AcoustID lookup results keyed by fingerprint and duration. Lookups
+// without results are cached too, with an expiry that doubles for each repeated miss. Unlike
+// the binary caches it is kept as json lines rather than a RecordLog, as entries are small,
+// few and variable in size, and a corrupt line is skipped without losing the ones after it.
+class LookupCache
+{
+public:
+  static void Init(const std::string& p_Path, int64_t p_TtlSec);
+  static void Cleanup();
+  static bool Get(const AcoustId::Fingerprint& p_Fingerprint,
+                  std::vector<AcoustId::Match>& p_Matches);
+  static void Set(const AcoustId::Fingerprint& p_Fingerprint,
+                  const std::vector<AcoustId::Match>& p_Matches);
+
+private:
+  struct Entry
+  {
+    int64_t time = 0;
+    int misses = 0;
+    std::vector<AcoustId::Match> matches;
+  };
+
+  static std::string GetKey(const AcoustId::Fingerprint& p_Fingerprint);
+  static int64_t GetExpiry(const Entry& p_Entry);
+  static void Load();
+  static void Compact();
+  static std::string Serialize(const std::string& p_Key, const Entry& p_Entry);
+
+private:
+  static std::mutex m_Mutex;
+  static std::string m_Path;
+  static int64_t m_TtlSec;
+  static bool m_Enabled;
+  static size_t m_DeadCount;
+  static std::unordered_map<std::string, Entry> m_Entries;
+};
@@ -0,0 +1,494 @@
+// lookupparser.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "lookupparser.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "log.h"
+#include "stats.h"
+#include "util.h"
+
+// Far above the responses for batches of popular tracks, while bounding a broken server
+static const size_t s_MaxSize = 16 * 1024 * 1024;
+
+// Start of the body kept for logging failed responses
+static const size_t s_MaxHeadSize = 1024;
+
+static bool IsElement(const char* p_Element, bool p_Array, const std::string& p_Key,
+                      size_t p_Index)
+{
+  // Path elements are object keys, any array index (*) or the first one (0)
+  if (strcmp(p_Element, "*") == 0) return p_Array;
+  if (strcmp(p_Element, "0") == 0) return p_Array && (p_Index == 0);
+  return !p_Array && (p_Key == p_Element);
+}
+
+static int GetHexValue(char p_Char)
+{
+  if ((p_Char >= '0') && (p_Char <= '9')) return p_Char - '0';
+  if ((p_Char >= 'a') && (p_Char <= 'f')) return p_Char - 'a' + 10;
+  if ((p_Char >= 'A') && (p_Char <= 'F')) return p_Char - 'A' + 10;
+  return -1;
+}
+
+LookupParser::LookupParser(size_t p_Count)
+  : m_Count(p_Count)
+  , m_Batch(p_Count != 1)
+  , m_Matches(p_Count)
+{
+}
+
+bool LookupParser::Feed(const char* p_Data, size_t p_Size)
+{
+  m_Size += p_Size;
+  if (m_Size > s_MaxSize)
+  {
+    if (!m_TooLarge)
+    {
+      Log::Debug("acoustid response too large");
+      Stats::AddCount("lookup.toolarge");
+      m_TooLarge = true;
+    }
+
+    return false;
+  }
+
+  if (m_Head.size() < s_MaxHeadSize)
+  {
+    m_Head.append(p_Data, std::min(p_Size, s_MaxHeadSize - m_Head.size()));
+  }
+
+  // Parsing stops at the first error, the rest of the body is still received and ignored
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; (i < p_Size) && (m_State != StateError); ++i)
+  {
+    // Plain characters of strings, the bulk of the body, are copied in runs
+    if ((m_State == StateString) && (m_HighSurrogate == 0))
+    {
+      const size_t runStart = i;
+      while ((i < p_Size) && (p_Data[i] != '"') && (p_Data[i] != '\\') &&
+             (static_cast<unsigned char>(p_Data[i]) >= 0x20))
+      {
+        ++i;
+      }
+
+      m_Token.append(p_Data + runStart, i - runStart);
+      if (i == p_Size)
+      {
+        break;
+      }
+    }
+
+    if (!Parse(p_Data[i]))
+    {
+      m_State = StateError;
+    }
+  }
+
+  m_ParseSec += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+bool LookupParser::Finish(std::vector<std::vector<AcoustId::Match>>& p_Matches)
+{
+  Stats::AddTime("lookup.parse", m_ParseSec);
+  if (m_Size == 0)
+  {
+    Log::Debug("acoustid response empty");
+    return false;
+  }
+
+  if (m_TooLarge || (m_State != StateDone) || !m_IsObject || (m_Status != "ok"))
+  {
+    Log::Debug("acoustid error (%s)", m_Head.c_str());
+    return false;
+  }
+
+  if (m_Batch && !m_HasFingerprints)
+  {
+    Log::Debug("acoustid no fingerprints (%s)", m_Head.c_str());
+    return false;
+  }
+
+  // A successful lookup without results is valid, and is cached as such
+  if (!m_Batch && m_Matches[0].empty())
+  {
+    Log::Debug("acoustid no results");
+  }
+
+  p_Matches.swap(m_Matches);
+  return true;
+}
+
+bool LookupParser::Parse(char p_Char)
+{
+  switch (m_State)
+  {
+    case StateString:
+      if (p_Char == '"')
+      {
+        return EndString();
+      }
+      else if (p_Char == '\\')
+      {
+        m_State = StateEscape;
+        return true;
+      }
+      else if (static_cast<unsigned char>(p_Char) < 0x20)
+      {
+        return false;
+      }
+
+      if (m_HighSurrogate != 0)
+      {
+        AddCodePoint(0);
+      }
+
+      m_Token += p_Char;
+      return true;
+
+    case StateEscape:
+    {
+      static const char* const s_Escapes = "\"\"\\\\//b\bf\fn\nr\rt\t";
+      m_State = StateString;
+      if (p_Char == 'u')
+      {
+        m_CodePoint = 0;
+        m_CodePointDigits = 0;
+        m_State = StateUnicode;
+        return true;
+      }
+
+      for (const char* escape = s_Escapes; *escape != '\0'; escape += 2)
+      {
+        if (*escape == p_Char)
+        {
+          AddCodePoint(0);
+          m_Token += *(escape + 1);
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    case StateUnicode:
+    {
+      const int value = GetHexValue(p_Char);
+      if (value < 0)
+      {
+        return false;
+      }
+
+      m_CodePoint = (m_CodePoint << 4) | static_cast<uint32_t>(value);
+      if (++m_CodePointDigits == 4)
+      {
+        AddCodePoint(m_CodePoint);
+        m_State = StateString;
+      }
+
+      return true;
+    }
+
+    case StateNumber:
+    case StateLiteral:
+      if ((m_State == StateNumber) ? (strchr("+-.0123456789eE", p_Char) != nullptr)
+                                   : ((p_Char >= 'a') && (p_Char <= 'z')))
+      {
+        m_Token += p_Char;
+        return true;
+      }
+
+      // The character after a number or literal is handled in the state following it
+      return EndScalar() && Parse(p_Char);
+
+    default:
+      break;
+  }
+
+  if ((p_Char == ' ') || (p_Char == '\t') || (p_Char == '\n') || (p_Char == '\r'))
+  {
+    return true;
+  }
+
+  switch (m_State)
+  {
+    case StateValueOrEnd:
+      return (p_Char == ']') ? EndContainer(true /*p_Array*/) : BeginValue(p_Char);
+
+    case StateValue:
+      return BeginValue(p_Char);
+
+    case StateKeyOrEnd:
+    case StateKey:
+      if ((p_Char == '}') && (m_State == StateKeyOrEnd))
+      {
+        return EndContainer(false /*p_Array*/);
+      }
+      else if (p_Char == '"')
+      {
+        m_StringIsKey = true;
+        m_Token.clear();
+        m_State = StateString;
+        return true;
+      }
+
+      return false;
+
+    case StateColon:
+      m_State = StateValue;
+      return (p_Char == ':');
+
+    case StateNext:
+    {
+      Frame& frame = m_Frames.back();
+      if (p_Char == ',')
+      {
+        m_State = frame.array ? StateValue : StateKey;
+        frame.index += frame.array ? 1 : 0;
+        return true;
+      }
+
+      return (p_Char == (frame.array ? ']' : '}')) && EndContainer(frame.array);
+    }
+
+    default:
+      return false;
+  }
+}
+
+bool LookupParser::BeginValue(char p_Char)
+{
+  m_Token.clear();
+  m_Token += p_Char;
+  if ((p_Char == '{') || (p_Char == '['))
+  {
+    const bool array = (p_Char == '[');
+    OnBegin(array);
+    m_Frames.push_back(Frame());
+    m_Frames.back().array = array;
+    m_State = array ? StateValueOrEnd : StateKeyOrEnd;
+  }
+  else if (p_Char == '"')
+  {
+    m_StringIsKey = false;
+    m_Token.clear();
+    m_State = StateString;
+  }
+  else if ((p_Char == '-') || ((p_Char >= '0') && (p_Char <= '9')))
+  {
+    m_State = StateNumber;
+  }
+  else if ((p_Char == 't') || (p_Char == 'f') || (p_Char == 'n'))
+  {
+    m_State = StateLiteral;
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+bool LookupParser::EndContainer(bool p_Array)
+{
+  m_Frames.pop_back();
+  OnEnd(p_Array);
+  EndValue();
+  return true;
+}
+
+bool LookupParser::EndString()
+{
+  AddCodePoint(0);
+  if (m_StringIsKey)
+  {
+    m_Frames.back().key = m_Token;
+    m_State = StateColon;
+    return true;
+  }
+
+  OnValue(TokenString);
+  EndValue();
+  return true;
+}
+
+bool LookupParser::EndScalar()
+{
+  if (m_State == StateNumber)
+  {
+    char* end = nullptr;
+    strtod(m_Token.c_str(), &end);
+    if ((end == m_Token.c_str()) || (*end != '\0'))
+    {
+      return false;
+    }
+
+    OnValue(TokenNumber);
+  }
+  else
+  {
+    if ((m_Token != "true") && (m_Token != "false") && (m_Token != "null"))
+    {
+      return false;
+    }
+
+    OnValue(TokenLiteral);
+  }
+
+  EndValue();
+  return true;
+}
+
+void LookupParser::EndValue()
+{
+  m_State = m_Frames.empty() ? StateDone : StateNext;
+}
+
+void LookupParser::AddCodePoint(uint32_t p_CodePoint)
+{
+  // Surrogate pairs are combined, and unpaired surrogates replaced, when the next code point
+  // or the end of the string (zero) is added
+  if ((p_CodePoint >= 0xdc00) && (p_CodePoint < 0xe000) && (m_HighSurrogate != 0))
+  {
+    p_CodePoint = 0x10000 + ((m_HighSurrogate - 0xd800) << 10) + (p_CodePoint - 0xdc00);
+    m_HighSurrogate = 0;
+  }
+  else if (m_HighSurrogate != 0)
+  {
+    m_Token += Util::Utf32ToUtf8(std::u32string(1, 0xfffd));
+    m_HighSurrogate = 0;
+  }
+
+  if ((p_CodePoint >= 0xd800) && (p_CodePoint < 0xdc00))
+  {
+    m_HighSurrogate = p_CodePoint;
+  }
+  else if ((p_CodePoint >= 0xdc00) && (p_CodePoint < 0xe000))
+  {
+    m_Token += Util::Utf32ToUtf8(std::u32string(1, 0xfffd));
+  }
+  else if (p_CodePoint != 0)
+  {
+    m_Token += Util::Utf32ToUtf8(std::u32string(1, static_cast<char32_t>(p_CodePoint)));
+  }
+}
+
+bool LookupParser::IsPath(bool p_InResult, std::initializer_list<const char*> p_Pattern) const
+{
+  // Results of batched lookups are nested in the entry of each fingerprint
+  static const char* const s_BatchPrefix[] = { "fingerprints", "*" };
+  const size_t prefixSize = (p_InResult && m_Batch) ? 2 : 0;
+  if (m_Frames.size() != (prefixSize + p_Pattern.size()))
+  {
+    return false;
+  }
+
+  size_t i = 0;
+  for (; i < prefixSize; ++i)
+  {
+    const Frame& frame = m_Frames[i];
+    if (!IsElement(s_BatchPrefix[i], frame.array, frame.key, frame.index))
+    {
+      return false;
+    }
+  }
+
+  for (const char* element : p_Pattern)
+  {
+    const Frame& frame = m_Frames[i++];
+    if (!IsElement(element, frame.array, frame.key, frame.index))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void LookupParser::OnBegin(bool p_Array)
+{
+  if (m_Frames.empty())
+  {
+    m_IsObject = !p_Array;
+  }
+  else if (p_Array)
+  {
+    m_HasFingerprints = m_HasFingerprints || IsPath(false /*p_InResult*/, { "fingerprints" });
+  }
+  else if (m_Batch && IsPath(false /*p_InResult*/, { "fingerprints", "*" }))
+  {
+    // Entries are matched to fingerprints by their index, or else by their position
+    m_ItemMatches.clear();
+    m_ItemIndex = static_cast<int>(m_Frames.back().index);
+    m_ItemIndexValid = true;
+  }
+  else if (IsPath(true /*p_InResult*/, { "results", "*" }))
+  {
+    m_Match = AcoustId::Match();
+  }
+}
+
+void LookupParser::OnEnd(bool p_Array)
+{
+  if (p_Array)
+  {
+    return;
+  }
+
+  if (IsPath(true /*p_InResult*/, { "results", "*" }))
+  {
+    if (!m_Match.artist.empty() && !m_Match.title.empty())
+    {
+      (m_Batch ? m_ItemMatches : m_Matches[0]).push_back(m_Match);
+    }
+  }
+  else if (m_Batch && IsPath(false /*p_InResult*/, { "fingerprints", "*" }))
+  {
+    if (m_ItemIndexValid && (m_ItemIndex >= 0) && (static_cast<size_t>(m_ItemIndex) < m_Count))
+    {
+      std::vector<AcoustId::Match>& matches = m_Matches[static_cast<size_t>(m_ItemIndex)];
+      matches.insert(matches.end(), m_ItemMatches.begin(), m_ItemMatches.end());
+    }
+  }
+}
+
+void LookupParser::OnValue(Token p_Token)
+{
+  if (p_Token == TokenString)
+  {
+    if (IsPath(false /*p_InResult*/, { "status" }))
+    {
+      m_Status = m_Token;
+    }
+    else if (IsPath(true /*p_InResult*/, { "results", "*", "recordings", "0", "title" }))
+    {
+      m_Match.title = Util::ToValidUtf8(m_Token);
+    }
+    else if (IsPath(true /*p_InResult*/,
+                    { "results", "*", "recordings", "0", "artists", "0", "name" }))
+    {
+      m_Match.artist = Util::ToValidUtf8(m_Token);
+    }
+  }
+
+  if (m_Batch && IsPath(false /*p_InResult*/, { "fingerprints", "*", "index" }))
+  {
+    // Indices are integers or strings holding them, entries with other indices are skipped
+    const bool isInteger = (p_Token == TokenString) ||
+      ((p_Token == TokenNumber) && (m_Token.find_first_of(".eE") == std::string::npos));
+    m_ItemIndexValid = isInteger && Util::ToInt(m_Token, m_ItemIndex);
+  }
+  else if ((p_Token == TokenNumber) && IsPath(true /*p_InResult*/, { "results", "*", "score" }))
+  {
+    m_Match.score = strtod(m_Token.c_str(), nullptr);
+  }
+}
@@ -0,0 +1,100 @@
+// lookupparser.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "acoustid.h"
+
+// Streaming parser of AcoustID lookup responses, fed with the body in chunks as they are
+// received. It tokenizes the JSON without building a document, and only keeps the fields of
+// the first recording of each result that make up a match, so that the large recording and
+// release group payloads of popular tracks are merely scanned. Responses above a size limit
+// are rejected.
+class LookupParser
+{
+public:
+  explicit LookupParser(size_t p_Count);
+
+  bool Feed(const char* p_Data, size_t p_Size);
+  bool Finish(std::vector<std::vector<AcoustId::Match>>& p_Matches);
+
+private:
+  enum State
+  {
+    StateValue,
+    StateValueOrEnd,
+    StateKey,
+    StateKeyOrEnd,
+    StateColon,
+    StateNext,
+    StateString,
+    StateEscape,
+    StateUnicode,
+    StateNumber,
+    StateLiteral,
+    StateDone,
+    StateError,
+  };
+
+  enum Token
+  {
+    TokenString,
+    TokenNumber,
+    TokenLiteral,
+  };
+
+  struct Frame
+  {
+    bool array = false;
+    std::string key;
+    size_t index = 0;
+  };
+
+  bool Parse(char p_Char);
+  bool BeginValue(char p_Char);
+  bool EndContainer(bool p_Array);
+  bool EndString();
+  bool EndScalar();
+  void EndValue();
+  void AddCodePoint(uint32_t p_CodePoint);
+  bool IsPath(bool p_InResult, std::initializer_list<const char*> p_Pattern) const;
+
+  void OnBegin(bool p_Array);
+  void OnEnd(bool p_Array);
+  void OnValue(Token p_Token);
+
+private:
+  size_t m_Count = 0;
+  bool m_Batch = false;
+  size_t m_Size = 0;
+  bool m_TooLarge = false;
+  std::string m_Head;
+  double m_ParseSec = 0.0;
+
+  State m_State = StateValue;
+  bool m_StringIsKey = false;
+  std::string m_Token;
+  uint32_t m_CodePoint = 0;
+  int m_CodePointDigits = 0;
+  uint32_t m_HighSurrogate = 0;
+  std::vector<Frame> m_Frames;
+
+  bool m_IsObject = false;
+  bool m_HasFingerprints = false;
+  std::string m_Status;
+  AcoustId::Match m_Match;
+  std::vector<AcoustId::Match> m_ItemMatches;
+  int m_ItemIndex = 0;
+  bool m_ItemIndexValid = false;
+  std::vector<std::vector<AcoustId::Match>> m_Matches;
+};
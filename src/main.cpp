@@ -7,29 +7,47 @@
 
 #include "main.h"
 
+#include <cmath>
 #include <iostream>
-#include <set>
 #include <string>
+#include <vector>
 
 #include "acoustid.h"
-#include "editor.h"
+#include "fpcache.h"
+#include "journal.h"
 #include "log.h"
-#include "tag.h"
+#include "lookupbatcher.h"
+#include "lookupcache.h"
+#include "offlinedb.h"
+#include "pipeline.h"
+#include "statedb.h"
+#include "stats.h"
 #include "util.h"
 #include "version.h"
 
+// Lowest lookup rate, one request per hour, keeping waits for tokens within sane durations
+static const double s_MinRate = 1.0 / 3600.0;
+
 static void ShowHelp(bool p_Verbose);
 static void ShowVersion();
 
 int main(int argc, char* argv[])
 {
-  bool clear = false;
-  bool detect = false;
-  bool edit = false;
-  bool rename = false;
-  std::string reportFormat = "%i : %r : %o";
+  Pipeline::Options options;
+  int batchSize = 10;
+  double rate = 3.0;
+  double burst = 1.0;
+  bool cache = true;
+  bool statsJson = false;
+  bool resume = false;
+  std::string journalPath;
+  std::string offlinePath;
+  std::string importPath;
+  int cacheTtlDays = 30;
+  std::string endpoint = AcoustId::DefaultEndpoint;
+  options.reportFormat = "%i : %r : %o";
   std::string invalidarg;
-  std::set<std::string> filePaths;
+  std::vector<std::string> paths;
 
   // Parse arguments
   std::vector<std::string> args(argv + 1, argv + argc);
@@ -39,29 +57,188 @@ int main(int argc, char* argv[])
     const bool hasNextArg = (std::distance(it + 1, args.end()) > 0);
     if ((arg == "-c") || (arg == "--clear"))
     {
-      clear = true;
+      options.clear = true;
+    }
+    else if ((arg == "--apply") && hasNextArg)
+    {
+      ++it;
+      if (!Util::Exists(*it))
+      {
+        invalidarg = *it;
+        break;
+      }
+
+      options.applyPath = *it;
+    }
+    else if (((arg == "-b") || (arg == "--batch")) && hasNextArg)
+    {
+      ++it;
+      if (!Util::ToInt(*it, batchSize) || (batchSize < 1))
+      {
+        invalidarg = *it;
+        break;
+      }
+    }
+    else if ((arg == "--burst") && hasNextArg)
+    {
+      ++it;
+      if (!Util::ToDouble(*it, burst) || !std::isfinite(burst) || (burst < 1.0))
+      {
+        invalidarg = *it;
+        break;
+      }
+    }
+    else if (((arg == "-C") || (arg == "--cache-ttl")) && hasNextArg)
+    {
+      ++it;
+      if (!Util::ToInt(*it, cacheTtlDays) || (cacheTtlDays < 0))
+      {
+        invalidarg = *it;
+        break;
+      }
     }
     else if ((arg == "-d") || (arg == "--detect"))
     {
-      detect = true;
+      options.detect = true;
+    }
+    else if ((arg == "--endpoint") && hasNextArg)
+    {
+      ++it;
+      endpoint = *it;
     }
     else if ((arg == "-e") || (arg == "--edit"))
     {
-      edit = true;
+      options.edit = true;
+    }
+    else if (arg == "--find-duplicates")
+    {
+      options.findDuplicates = true;
     }
     else if ((arg == "-h") || (arg == "--help"))
     {
       ShowHelp(true /*p_Verbose*/);
       return 0;
     }
+    else if (arg == "--incremental")
+    {
+      options.incremental = true;
+    }
+    else if ((arg == "--import-db") && hasNextArg)
+    {
+      ++it;
+      if (!Util::Exists(*it))
+      {
+        invalidarg = *it;
+        break;
+      }
+
+      importPath = *it;
+    }
+    else if ((arg == "--journal") && hasNextArg)
+    {
+      ++it;
+      journalPath = *it;
+    }
+    else if (((arg == "-j") || (arg == "--jobs")) && hasNextArg)
+    {
+      ++it;
+      if (!Util::ToInt(*it, options.jobs) || (options.jobs < 1))
+      {
+        invalidarg = *it;
+        break;
+      }
+    }
+    else if ((arg == "-n") || (arg == "--no-cache"))
+    {
+      cache = false;
+    }
+    else if ((arg == "--offline-db") && hasNextArg)
+    {
+      ++it;
+      offlinePath = *it;
+    }
+    else if ((arg == "--padding") && hasNextArg)
+    {
+      ++it;
+      if (!Util::ToInt(*it, options.padding) || (options.padding < 0) ||
+          (options.padding > (16 * 1024 * 1024)))
+      {
+        invalidarg = *it;
+        break;
+      }
+    }
+    else if ((arg == "--plan") && hasNextArg)
+    {
+      ++it;
+      options.planPath = *it;
+    }
+    else if ((arg == "--rate") && hasNextArg)
+    {
+      ++it;
+      if (!Util::ToDouble(*it, rate) || !std::isfinite(rate) || (rate < s_MinRate))
+      {
+        invalidarg = *it;
+        break;
+      }
+    }
     else if ((arg == "-r") || (arg == "--rename"))
     {
-      rename = true;
+      options.rename = true;
     }
     else if (((arg == "-R") || (arg == "--report")) && hasNextArg)
     {
       ++it;
-      reportFormat = *it;
+      options.reportFormat = *it;
+    }
+    else if ((arg == "--report-format") && hasNextArg)
+    {
+      ++it;
+      if ((*it != "text") && (*it != "jsonl"))
+      {
+        invalidarg = *it;
+        break;
+      }
+
+      options.reportJson = (*it == "jsonl");
+    }
+    else if (arg == "--resume")
+    {
+      resume = true;
+    }
+    else if ((arg == "--since") && hasNextArg)
+    {
+      ++it;
+      if (!Util::ToTime(*it, options.sinceSec))
+      {
+        invalidarg = *it;
+        break;
+      }
+    }
+    else if (arg == "--sniff")
+    {
+      options.sniff = true;
+    }
+    else if (arg == "--stats")
+    {
+      Stats::SetEnabled(true);
+    }
+    else if (arg == "--stats-json")
+    {
+      Stats::SetEnabled(true);
+      statsJson = true;
+    }
+    else if ((arg == "--stage-jobs") && hasNextArg)
+    {
+      ++it;
+      if (!Pipeline::ParseStageJobs(*it, options.stageJobs))
+      {
+        invalidarg = *it;
+        break;
+      }
+    }
+    else if ((arg == "-u") || (arg == "--unordered"))
+    {
+      options.unordered = true;
     }
     else if ((arg == "-v") || (arg == "--verbose"))
     {
@@ -74,7 +251,7 @@ int main(int argc, char* argv[])
     }
     else if (Util::Exists(arg))
     {
-      Util::ListFiles(arg, filePaths);
+      paths.push_back(arg);
     }
     else
     {
@@ -90,13 +267,49 @@ int main(int argc, char* argv[])
     ShowHelp(false /*p_Verbose*/);
     return 1;
   }
-  else if (filePaths.empty())
+  else if (resume && journalPath.empty())
+  {
+    std::cerr << "ERROR: --resume requires --journal\n\n";
+    ShowHelp(false /*p_Verbose*/);
+    return 3;
+  }
+  else if (!importPath.empty())
+  {
+    if (offlinePath.empty() || !paths.empty() || options.clear || options.detect ||
+        options.edit || options.rename || options.findDuplicates)
+    {
+      std::cerr << "ERROR: --import-db requires --offline-db and takes no path(s)\n\n";
+      ShowHelp(false /*p_Verbose*/);
+      return 3;
+    }
+  }
+  else if (!options.applyPath.empty())
+  {
+    if (!paths.empty() || !options.planPath.empty() || options.clear || options.detect ||
+        options.edit || options.rename)
+    {
+      std::cerr << "ERROR: --apply takes the path(s) and operations from the plan\n\n";
+      ShowHelp(false /*p_Verbose*/);
+      return 3;
+    }
+  }
+  else if (paths.empty())
   {
     std::cerr << "ERROR: No path(s) specified\n\n";
     ShowHelp(false /*p_Verbose*/);
     return 2;
   }
-  else if (!clear && !detect && !edit && !rename)
+  else if (options.findDuplicates)
+  {
+    if (options.clear || options.detect || options.edit || options.rename ||
+        !options.planPath.empty() || !journalPath.empty() || options.incremental)
+    {
+      std::cerr << "ERROR: --find-duplicates cannot be combined with other operations\n\n";
+      ShowHelp(false /*p_Verbose*/);
+      return 3;
+    }
+  }
+  else if (!options.clear && !options.detect && !options.edit && !options.rename)
   {
     std::cerr <<
       "ERROR: Requires at least one operation of:\n"
@@ -105,61 +318,79 @@ int main(int argc, char* argv[])
     return 3;
   }
 
-  // Process input files
-  bool resultAll = true;
-  for (const auto& filePath : filePaths)
+  if (!importPath.empty())
   {
-    std::string artist;
-    std::string title;
-    bool result = true;
-
-    if (Util::ToLower(Util::GetFileExt(filePath)) != ".mp3")
+    size_t count = 0;
+    if (!OfflineDb::Import(importPath, offlinePath, count))
     {
-      result = false;
+      std::cerr << "ERROR: Failed to import '" << importPath << "'\n";
+      return 1;
     }
 
-    if (result && clear)
-    {
-      result = Tag::Clear(filePath);
-    }
+    std::cout << "Imported " << count << " fingerprints into " << offlinePath << "\n";
+    return 0;
+  }
 
-    if (result && (detect || edit || rename))
-    {
-      Tag::Read(filePath, artist, title);
-      result = detect || edit || (!artist.empty() && !title.empty());
-    }
+  if (!offlinePath.empty() && !OfflineDb::Init(offlinePath))
+  {
+    std::cerr << "ERROR: Failed to open offline database '" << offlinePath << "'\n";
+    return 1;
+  }
 
-    if (result && detect)
-    {
-      result = AcoustId::Identify(filePath, artist, title);
-    }
+  if (!journalPath.empty() && !Journal::Init(journalPath, resume))
+  {
+    std::cerr << "ERROR: Failed to open journal '" << journalPath << "'\n";
+    return 1;
+  }
 
-    if (result && edit)
+  if (options.incremental)
+  {
+    const std::string cacheDir = Util::GetCacheDir();
+    if (cacheDir.empty())
     {
-      result = Editor::Edit(filePath, artist, title);
+      std::cerr << "ERROR: Failed to access cache dir for --incremental state\n";
+      return 1;
     }
 
-    std::string newFilePath = filePath;
-    if (result && (detect || edit || rename))
+    StateDb::Init(cacheDir + "/state");
+  }
+
+  AcoustId::Init(endpoint);
+  LookupBatcher::Init(batchSize, rate, burst);
+
+  if (cache)
+  {
+    const std::string cacheDir = Util::GetCacheDir();
+    if (!cacheDir.empty())
     {
-      result = Tag::Write(filePath, artist, title);
+      FpCache::Init(cacheDir + "/fingerprints");
 
-      if (result && rename)
+      // Results from other endpoints, e.g. a mock server, must not end up in the cache
+      if ((endpoint == AcoustId::DefaultEndpoint) && offlinePath.empty())
       {
-        newFilePath = Tag::MakePath(filePath, artist, title);
-        result = Util::Rename(filePath, newFilePath);
+        LookupCache::Init(cacheDir + "/lookups",
+                          static_cast<int64_t>(cacheTtlDays) * 24 * 60 * 60);
       }
     }
+  }
 
-    const std::string report = Util::MakeReport(reportFormat, filePath, newFilePath, result);
-    if (!report.empty())
-    {
-      std::cout << report << "\n";
-    }
-
-    resultAll = resultAll && result;
+  bool resultAll = true;
+  {
+    Stats::Timer timer("run.total");
+    Pipeline pipeline(options);
+    resultAll = pipeline.Run(paths);
   }
 
+  Stats::Print(statsJson);
+
+  Journal::Cleanup();
+  StateDb::Cleanup();
+  LookupCache::Cleanup();
+  OfflineDb::Cleanup();
+  FpCache::Cleanup();
+  LookupBatcher::Cleanup();
+  AcoustId::Cleanup();
+
   return (resultAll ? 0 : 1);
 }
 
@@ -181,8 +412,31 @@ void ShowHelp(bool p_Verbose)
       "    -d, --detect           detect / identify audio\n"
       "    -e, --edit             edit / confirm detected tags\n"
       "    -r, --rename           rename file based on tags\n"
+      "        --find-duplicates  list groups of files with the same recording\n"
       "\n"
+      "    -b, --batch            max fingerprints per lookup request (default 10)\n"
+      "    -C, --cache-ttl        days to keep cached lookup results (default 30)\n"
+      "    -j, --jobs             number of files to process in parallel\n"
+      "    -n, --no-cache         disable local caches\n"
       "    -R, --report           specify report format\n"
+      "    -u, --unordered        report files in completion order\n"
+      "        --rate             max lookup requests per second (default 3)\n"
+      "        --burst            max lookup requests in a burst (default 1)\n"
+      "        --endpoint         lookup service url (default AcoustID)\n"
+      "        --offline-db       identify using specified local database instead\n"
+      "        --import-db        import json lines dataset into the --offline-db file\n"
+      "        --padding          bytes reserved when a tag grows, for in-place edits\n"
+      "        --plan             write proposed changes to a json lines file instead\n"
+      "        --apply            apply the changes in a json lines file from --plan\n"
+      "        --journal          record completed files in specified journal file\n"
+      "        --resume           skip files completed according to the journal\n"
+      "        --incremental      skip files unchanged since processed successfully\n"
+      "        --since            skip files modified before date, e.g. 2025-01-31\n"
+      "        --report-format    report as text (default) or jsonl\n"
+      "        --sniff            skip non-mp3 or too short files in directories\n"
+      "        --stage-jobs       workers per stage, e.g. lookup=16,write=2\n"
+      "        --stats            print timing statistics to stderr at exit\n"
+      "        --stats-json       print timing statistics as json\n"
       "    -h, --help             display help\n"
       "    -v, --verbose          enable verbose debug output\n"
       "    -V, --version          display version information\n"
@@ -197,6 +451,13 @@ void ShowHelp(bool p_Verbose)
       "    %i          input file name\n"
       "    %o          output file name\n"
       "    %r          result (PASS or FAIL)\n"
+      "    %a          artist\n"
+      "    %t          title\n"
+      "    %s          match score\n"
+      "    %f          fingerprint cache (hit or miss)\n"
+      "    %l          lookup cache (hit or miss)\n"
+      "    %S          time per stage in ms\n"
+      "    %T          total time in ms\n"
       "\n"
       "Interactive editor commands:\n"
       "    Enter       next field / save\n"
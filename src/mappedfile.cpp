@@ -0,0 +1,85 @@
+// mappedfile.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "stats.h"
+
+MappedFile::MappedFile()
+{
+}
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+bool MappedFile::Open(const std::string& p_FilePath)
+{
+  Close();
+  m_Path = p_FilePath;
+  const int fd = open(p_FilePath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+  {
+    Log::Debug("map open failed for %s", p_FilePath.c_str());
+    return false;
+  }
+
+  // Empty files cannot be mapped, and hold no audio anyway
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size == 0))
+  {
+    close(fd);
+    return false;
+  }
+
+  // The mapping stays valid after closing the descriptor
+  const size_t size = static_cast<size_t>(st.st_size);
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    Log::Debug("map failed for %s", p_FilePath.c_str());
+    return false;
+  }
+
+  m_Data = static_cast<const char*>(data);
+  m_Size = size;
+  Stats::AddCount("file.mapped");
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if (m_Data != nullptr)
+  {
+    munmap(const_cast<char*>(m_Data), m_Size);
+    m_Data = nullptr;
+    m_Size = 0;
+  }
+}
+
+const std::string& MappedFile::GetPath() const
+{
+  return m_Path;
+}
+
+const char* MappedFile::GetData() const
+{
+  return m_Data;
+}
+
+size_t MappedFile::GetSize() const
+{
+  return m_Size;
+}
@@ -0,0 +1,33 @@
+// mappedfile.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file, shared by the tag and fingerprint stages so that
+// each file is read once, straight from the page cache.
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool Open(const std::string& p_FilePath);
+  void Close();
+  const std::string& GetPath() const;
+  const char* GetData() const;
+  size_t GetSize() const;
+
+private:
+  std::string m_Path;
+  const char* m_Data = nullptr;
+  size_t m_Size = 0;
+};
@@ -0,0 +1,155 @@
+// mappedstream.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "mappedstream.h"
+
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "stats.h"
+
+MappedStream::MappedStream(const std::shared_ptr<MappedFile>& p_MappedFile)
+  : m_MappedFile(p_MappedFile)
+  , m_ReadOnly(access(p_MappedFile->GetPath().c_str(), W_OK) != 0)
+{
+}
+
+MappedStream::~MappedStream()
+{
+}
+
+TagLib::FileName MappedStream::name() const
+{
+  return m_MappedFile->GetPath().c_str();
+}
+
+TagLib::ByteVector MappedStream::readBlock(Size p_Length)
+{
+  if (m_FileStream)
+  {
+    return m_FileStream->readBlock(p_Length);
+  }
+
+  const Offset size = static_cast<Offset>(m_MappedFile->GetSize());
+  if ((p_Length == 0) || (m_Position >= size))
+  {
+    return TagLib::ByteVector();
+  }
+
+  const Offset length = std::min(static_cast<Offset>(p_Length), size - m_Position);
+  const TagLib::ByteVector data(m_MappedFile->GetData() + m_Position,
+                                static_cast<unsigned int>(length));
+  m_Position += length;
+  return data;
+}
+
+void MappedStream::writeBlock(const TagLib::ByteVector& p_Data)
+{
+  if (TagLib::IOStream* writer = GetWriter())
+  {
+    writer->writeBlock(p_Data);
+  }
+}
+
+void MappedStream::insert(const TagLib::ByteVector& p_Data, Start p_Start, Size p_Replace)
+{
+  if (TagLib::IOStream* writer = GetWriter())
+  {
+    writer->insert(p_Data, p_Start, p_Replace);
+  }
+}
+
+void MappedStream::removeBlock(Start p_Start, Size p_Length)
+{
+  if (TagLib::IOStream* writer = GetWriter())
+  {
+    writer->removeBlock(p_Start, p_Length);
+  }
+}
+
+bool MappedStream::readOnly() const
+{
+  return m_FileStream ? m_FileStream->readOnly() : m_ReadOnly;
+}
+
+bool MappedStream::isOpen() const
+{
+  return m_FileStream ? m_FileStream->isOpen() : (m_MappedFile->GetData() != nullptr);
+}
+
+void MappedStream::seek(Offset p_Offset, Position p_Position)
+{
+  if (m_FileStream)
+  {
+    m_FileStream->seek(p_Offset, p_Position);
+    return;
+  }
+
+  switch (p_Position)
+  {
+    case Beginning:
+      m_Position = p_Offset;
+      break;
+
+    case Current:
+      m_Position += p_Offset;
+      break;
+
+    case End:
+      m_Position = static_cast<Offset>(m_MappedFile->GetSize()) + p_Offset;
+      break;
+
+    default:
+      break;
+  }
+
+  m_Position = std::max<Offset>(m_Position, 0);
+}
+
+void MappedStream::clear()
+{
+  if (m_FileStream)
+  {
+    m_FileStream->clear();
+  }
+}
+
+MappedStream::Offset MappedStream::tell() const
+{
+  return m_FileStream ? m_FileStream->tell() : m_Position;
+}
+
+MappedStream::Offset MappedStream::length()
+{
+  return m_FileStream ? m_FileStream->length() : static_cast<Offset>(m_MappedFile->GetSize());
+}
+
+void MappedStream::truncate(Offset p_Length)
+{
+  if (TagLib::IOStream* writer = GetWriter())
+  {
+    writer->truncate(p_Length);
+  }
+}
+
+TagLib::IOStream* MappedStream::GetWriter()
+{
+  if (!m_FileStream)
+  {
+    if (m_ReadOnly)
+    {
+      return nullptr;
+    }
+
+    Stats::AddCount("file.reopened");
+    m_FileStream.reset(new TagLib::FileStream(name(), false /*openReadOnly*/));
+    m_FileStream->seek(m_Position);
+  }
+
+  return m_FileStream.get();
+}
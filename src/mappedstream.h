@@ -0,0 +1,59 @@
+// mappedstream.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <memory>
+
+#include <taglib/taglib.h>
+#include <taglib/tfilestream.h>
+#include <taglib/tiostream.h>
+
+#include "mappedfile.h"
+
+// TagLib stream reading from a memory-mapped file without copying it to a file buffer first.
+// The first write opens the file with a regular file stream, which then serves all further
+// calls, as the mapping does not follow changes in file size.
+class MappedStream : public TagLib::IOStream
+{
+public:
+#if TAGLIB_MAJOR_VERSION >= 2
+  typedef TagLib::offset_t Offset;
+  typedef TagLib::offset_t Start;
+  typedef size_t Size;
+#else
+  typedef long Offset;
+  typedef TagLib::ulong Start;
+  typedef TagLib::ulong Size;
+#endif
+
+public:
+  explicit MappedStream(const std::shared_ptr<MappedFile>& p_MappedFile);
+  ~MappedStream() override;
+
+  TagLib::FileName name() const override;
+  TagLib::ByteVector readBlock(Size p_Length) override;
+  void writeBlock(const TagLib::ByteVector& p_Data) override;
+  void insert(const TagLib::ByteVector& p_Data, Start p_Start = 0, Size p_Replace = 0) override;
+  void removeBlock(Start p_Start = 0, Size p_Length = 0) override;
+  bool readOnly() const override;
+  bool isOpen() const override;
+  void seek(Offset p_Offset, Position p_Position = Beginning) override;
+  void clear() override;
+  Offset tell() const override;
+  Offset length() override;
+  void truncate(Offset p_Length) override;
+
+private:
+  TagLib::IOStream* GetWriter();
+
+private:
+  std::shared_ptr<MappedFile> m_MappedFile;
+  std::unique_ptr<TagLib::FileStream> m_FileStream;
+  Offset m_Position = 0;
+  bool m_ReadOnly = true;
+};
@@ -0,0 +1,104 @@
+// nameindex.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "nameindex.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <filesystem>
+
+#include "log.h"
+#include "util.h"
+
+std::map<std::string, std::shared_ptr<NameIndex::Dir>> NameIndex::m_Dirs;
+std::mutex NameIndex::m_Mutex;
+
+std::string NameIndex::Reserve(const std::string& p_DirPath, const std::string& p_BaseName,
+                               const std::string& p_Extension)
+{
+  std::shared_ptr<Dir> dir = GetDir(p_DirPath);
+  std::lock_guard<std::mutex> lock(dir->mutex);
+  if (!dir->loaded)
+  {
+    Load(p_DirPath, *dir);
+  }
+
+  // Start with the base filename, if taken append the lowest free _1, _2, _3 ...
+  std::string name = p_BaseName + p_Extension;
+  if (dir->names.count(name) > 0)
+  {
+    int& counter = dir->nextCounters.emplace(p_BaseName, 1).first->second;
+    do
+    {
+      name = p_BaseName + "_" + std::to_string(counter++) + p_Extension;
+    }
+    while (dir->names.count(name) > 0);
+  }
+
+  dir->names.insert(name);
+  return (std::filesystem::path(p_DirPath) / name).string();
+}
+
+void NameIndex::Release(const std::string& p_FilePath)
+{
+  const std::filesystem::path path(p_FilePath);
+  std::shared_ptr<Dir> dir = GetDir(path.parent_path().string());
+  std::lock_guard<std::mutex> lock(dir->mutex);
+  if (!dir->loaded)
+  {
+    return;
+  }
+
+  const std::string name = path.filename().string();
+  dir->names.erase(name);
+
+  // A freed numbered name is handed out again before higher numbers
+  const std::string stem = path.stem().string();
+  const size_t pos = stem.find_last_of('_');
+  int counter = 0;
+  if ((pos != std::string::npos) && Util::ToInt(stem.substr(pos + 1), counter))
+  {
+    auto it = dir->nextCounters.find(stem.substr(0, pos));
+    if (it != dir->nextCounters.end())
+    {
+      it->second = std::min(it->second, counter);
+    }
+  }
+}
+
+std::shared_ptr<NameIndex::Dir> NameIndex::GetDir(const std::string& p_DirPath)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::shared_ptr<Dir>& dir = m_Dirs[p_DirPath];
+  if (!dir)
+  {
+    dir = std::make_shared<Dir>();
+  }
+
+  return dir;
+}
+
+void NameIndex::Load(const std::string& p_DirPath, Dir& p_Dir)
+{
+  p_Dir.loaded = true;
+  DIR* dirp = opendir(p_DirPath.empty() ? "." : p_DirPath.c_str());
+  if (dirp == nullptr)
+  {
+    Log::Debug("opendir failed for %s", p_DirPath.c_str());
+    return;
+  }
+
+  struct dirent* dent = nullptr;
+  while ((dent = readdir(dirp)) != nullptr)
+  {
+    p_Dir.names.insert(dent->d_name);
+  }
+
+  closedir(dirp);
+  Log::Debug("name index loaded %zu names for %s", p_Dir.names.size(), p_DirPath.c_str());
+}
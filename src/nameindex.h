@@ -0,0 +1,41 @@
+// nameindex.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// In-memory index of file names per directory, listed once on first use, which hands out
+// free names for renames and reserves them atomically across threads.
+class NameIndex
+{
+public:
+  static std::string Reserve(const std::string& p_DirPath, const std::string& p_BaseName,
+                             const std::string& p_Extension);
+  static void Release(const std::string& p_FilePath);
+
+private:
+  struct Dir
+  {
+    bool loaded = false;
+    std::unordered_set<std::string> names;
+    std::unordered_map<std::string, int> nextCounters;
+    std::mutex mutex;
+  };
+
+  static std::shared_ptr<Dir> GetDir(const std::string& p_DirPath);
+  static void Load(const std::string& p_DirPath, Dir& p_Dir);
+
+private:
+  static std::map<std::string, std::shared_ptr<Dir>> m_Dirs;
+  static std::mutex m_Mutex;
+};
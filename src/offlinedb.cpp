@@ -0,0 +1,340 @@
+// offlinedb.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "offlinedb.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#include <nlohmann/json.hpp>
+
+#include "fpindex.h"
+#include "log.h"
+#include "mappedfile.h"
+#include "stats.h"
+
+static const char s_Magic[8] = { 'I', 'D', 'N', 'T', 'O', 'D', 'B', '1' };
+
+// Stored sub-fingerprints per recording, about two minutes like the fingerprints of files
+static const size_t s_MaxValues = 1024;
+
+// Recordings differing more in duration are not considered, like AcoustID does
+static const int s_MaxDurationDiffSec = 7;
+
+// Share of equal fingerprint bits for a match, scores are scaled from it so that unrelated
+// audio, at about one half, would score 0 and identical audio 1
+static const double s_MinSimilarity = 0.75;
+
+// On-disk header, followed by records, sub-fingerprints, index directory, index entries
+// and strings, all in native byte order
+struct Header
+{
+  char magic[8];
+  uint64_t recordCount;
+  uint64_t valueCount;
+  uint64_t entryCount;
+  uint64_t stringsSize;
+};
+
+struct Record
+{
+  uint64_t valuesOffset;
+  uint64_t stringsOffset;
+  uint32_t valuesCount;
+  uint32_t durationSec;
+  uint32_t artistSize;
+  uint32_t titleSize;
+};
+
+static_assert((sizeof(Header) % 8) == 0, "header breaks section alignment");
+static_assert((sizeof(Record) % 8) == 0, "record breaks section alignment");
+
+struct Layout
+{
+  size_t records = 0;
+  size_t values = 0;
+  size_t directory = 0;
+  size_t entries = 0;
+  size_t strings = 0;
+  size_t size = 0;
+};
+
+static Layout GetLayout(const Header& p_Header)
+{
+  // Sub-fingerprints are padded to an even count to keep the index 64-bit aligned
+  Layout layout;
+  layout.records = sizeof(Header);
+  layout.values = layout.records + (p_Header.recordCount * sizeof(Record));
+  layout.directory = layout.values + (((p_Header.valueCount + 1) / 2) * sizeof(uint64_t));
+  layout.entries = layout.directory + (FpIndex::GetDirectorySize() * sizeof(uint64_t));
+  layout.strings = layout.entries + (p_Header.entryCount * sizeof(uint64_t));
+  layout.size = layout.strings + p_Header.stringsSize;
+  return layout;
+}
+
+template <typename T>
+static const T* GetSection(const char* p_Data, size_t p_Offset)
+{
+  return reinterpret_cast<const T*>(p_Data + p_Offset);
+}
+
+template <typename T>
+static void WriteSection(std::ofstream& p_File, const std::vector<T>& p_Items)
+{
+  p_File.write(reinterpret_cast<const char*>(p_Items.data()),
+               static_cast<std::streamsize>(p_Items.size() * sizeof(T)));
+}
+
+std::unique_ptr<MappedFile> OfflineDb::m_File;
+
+bool OfflineDb::Init(const std::string& p_Path)
+{
+  m_File.reset(new MappedFile());
+  if (!m_File->Open(p_Path))
+  {
+    Log::Debug("offline db open failed (%s)", p_Path.c_str());
+    m_File.reset();
+    return false;
+  }
+
+  if (!Validate(m_File->GetData(), m_File->GetSize()))
+  {
+    Log::Debug("offline db invalid (%s)", p_Path.c_str());
+    m_File.reset();
+    return false;
+  }
+
+  return true;
+}
+
+void OfflineDb::Cleanup()
+{
+  m_File.reset();
+}
+
+bool OfflineDb::IsEnabled()
+{
+  return static_cast<bool>(m_File);
+}
+
+void OfflineDb::Lookup(const AcoustId::Fingerprint& p_Fingerprint,
+                       std::vector<AcoustId::Match>& p_Matches)
+{
+  Stats::Timer timer("offline.lookup");
+  p_Matches.clear();
+  std::vector<uint32_t> values;
+  if (!FpIndex::Decode(p_Fingerprint.fp, values))
+  {
+    Log::Debug("offline lookup invalid fingerprint");
+    return;
+  }
+
+  const char* data = m_File->GetData();
+  const Header& header = *GetSection<Header>(data, 0);
+  const Layout layout = GetLayout(header);
+  const Record* records = GetSection<Record>(data, layout.records);
+  const uint32_t* recordValues = GetSection<uint32_t>(data, layout.values);
+  std::vector<uint64_t> votes;
+  std::vector<FpIndex::Candidate> candidates;
+  FpIndex::FindCandidates(GetSection<uint64_t>(data, layout.entries),
+                          GetSection<uint64_t>(data, layout.directory), values.data(),
+                          values.size(), static_cast<size_t>(header.recordCount), votes,
+                          candidates);
+
+  // Best similarity per recording, over the offsets found for it
+  std::map<size_t, double> similarities;
+  for (const FpIndex::Candidate& candidate : candidates)
+  {
+    const Record& record = records[candidate.track];
+    if ((record.durationSec > 0) && (p_Fingerprint.duration_sec > 0) &&
+        (std::abs(static_cast<int>(record.durationSec) - p_Fingerprint.duration_sec) >
+         s_MaxDurationDiffSec))
+    {
+      continue;
+    }
+
+    const double similarity =
+      FpIndex::GetSimilarity(values.data(), values.size(), recordValues + record.valuesOffset,
+                             record.valuesCount, candidate.offset);
+    if (similarity >= s_MinSimilarity)
+    {
+      double& best = similarities[candidate.track];
+      best = std::max(best, similarity);
+    }
+  }
+
+  const char* strings = data + layout.strings;
+  for (const auto& similarity : similarities)
+  {
+    const Record& record = records[similarity.first];
+    AcoustId::Match match;
+    match.artist.assign(strings + record.stringsOffset, record.artistSize);
+    match.title.assign(strings + record.stringsOffset + record.artistSize, record.titleSize);
+    match.score = (similarity.second - 0.5) * 2.0;
+    p_Matches.push_back(match);
+  }
+
+  std::stable_sort(p_Matches.begin(), p_Matches.end(),
+                   [](const AcoustId::Match& p_Lhs, const AcoustId::Match& p_Rhs)
+  {
+    return p_Lhs.score > p_Rhs.score;
+  });
+
+  Log::Debug("offline lookup %zu candidates %zu matches", candidates.size(), p_Matches.size());
+}
+
+bool OfflineDb::Import(const std::string& p_DatasetPath, const std::string& p_Path,
+                       size_t& p_Count)
+{
+  std::ifstream dataset(p_DatasetPath);
+  if (!dataset)
+  {
+    Log::Debug("offline dataset open failed (%s)", p_DatasetPath.c_str());
+    return false;
+  }
+
+  // Entries hold a fingerprint as computed by fpcalc, the recording and optionally its duration
+  std::vector<Record> records;
+  std::vector<uint32_t> values;
+  std::vector<uint64_t> entries;
+  std::string strings;
+  std::vector<uint32_t> entryValues;
+  std::string line;
+  while (std::getline(dataset, line))
+  {
+    const nlohmann::json entry = nlohmann::json::parse(line, nullptr, false /*allow_exceptions*/);
+    if (entry.is_discarded() || !entry.is_object() ||
+        !entry.value("fingerprint", nlohmann::json()).is_string() ||
+        !entry.value("artist", nlohmann::json()).is_string() ||
+        !entry.value("title", nlohmann::json()).is_string() ||
+        !FpIndex::Decode(entry["fingerprint"].get<std::string>(), entryValues))
+    {
+      Log::Debug("skip dataset entry %s", line.c_str());
+      continue;
+    }
+
+    if (records.size() >= UINT32_MAX)
+    {
+      Log::Debug("offline dataset too large (%s)", p_DatasetPath.c_str());
+      return false;
+    }
+
+    const std::string artist = entry["artist"].get<std::string>();
+    const std::string title = entry["title"].get<std::string>();
+    const nlohmann::json duration = entry.value("duration", nlohmann::json());
+    entryValues.resize(std::min(entryValues.size(), s_MaxValues));
+
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.valuesOffset = values.size();
+    record.stringsOffset = strings.size();
+    record.valuesCount = static_cast<uint32_t>(entryValues.size());
+    record.durationSec = duration.is_number() ? static_cast<uint32_t>(
+      std::max(0.0, duration.get<double>())) : 0;
+    record.artistSize = static_cast<uint32_t>(artist.size());
+    record.titleSize = static_cast<uint32_t>(title.size());
+
+    FpIndex::AddEntries(entryValues.data(), entryValues.size(), records.size(), entries);
+    values.insert(values.end(), entryValues.begin(), entryValues.end());
+    strings += artist + title;
+    records.push_back(record);
+  }
+
+  std::sort(entries.begin(), entries.end());
+  std::vector<uint64_t> directory;
+  FpIndex::MakeDirectory(entries, directory);
+
+  Header header;
+  memcpy(header.magic, s_Magic, sizeof(s_Magic));
+  header.recordCount = records.size();
+  header.valueCount = values.size();
+  header.entryCount = entries.size();
+  header.stringsSize = strings.size();
+  values.resize(values.size() + (values.size() % 2));
+
+  // Written to a temporary file first, so that a failed import keeps the previous database
+  const std::string tmpPath = p_Path + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    WriteSection(file, records);
+    WriteSection(file, values);
+    WriteSection(file, directory);
+    WriteSection(file, entries);
+    file.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+    file.close();
+    if (!file)
+    {
+      Log::Debug("offline db write failed (%s)", tmpPath.c_str());
+      remove(tmpPath.c_str());
+      return false;
+    }
+  }
+
+  if (rename(tmpPath.c_str(), p_Path.c_str()) != 0)
+  {
+    Log::Debug("offline db rename failed (%s)", p_Path.c_str());
+    remove(tmpPath.c_str());
+    return false;
+  }
+
+  p_Count = records.size();
+  return true;
+}
+
+bool OfflineDb::Validate(const char* p_Data, size_t p_Size)
+{
+  if ((p_Size < sizeof(Header)) || (memcmp(p_Data, s_Magic, sizeof(s_Magic)) != 0))
+  {
+    return false;
+  }
+
+  // Counts are bounded by the file size before computing the layout from them
+  const Header& header = *GetSection<Header>(p_Data, 0);
+  if ((header.recordCount > (p_Size / sizeof(Record))) ||
+      (header.valueCount > (p_Size / sizeof(uint32_t))) ||
+      (header.entryCount > (p_Size / sizeof(uint64_t))) || (header.stringsSize > p_Size))
+  {
+    return false;
+  }
+
+  const Layout layout = GetLayout(header);
+  if (layout.size != p_Size)
+  {
+    return false;
+  }
+
+  const Record* records = GetSection<Record>(p_Data, layout.records);
+  for (size_t i = 0; i < header.recordCount; ++i)
+  {
+    const Record& record = records[i];
+    if ((record.valuesOffset > header.valueCount) ||
+        (record.valuesCount > (header.valueCount - record.valuesOffset)) ||
+        (record.stringsOffset > header.stringsSize) ||
+        ((static_cast<uint64_t>(record.artistSize) + record.titleSize) >
+         (header.stringsSize - record.stringsOffset)))
+    {
+      return false;
+    }
+  }
+
+  const uint64_t* directory = GetSection<uint64_t>(p_Data, layout.directory);
+  const size_t directorySize = FpIndex::GetDirectorySize();
+  for (size_t i = 1; i < directorySize; ++i)
+  {
+    if (directory[i - 1] > directory[i])
+    {
+      return false;
+    }
+  }
+
+  return (directory[directorySize - 1] == header.entryCount);
+}
@@ -0,0 +1,39 @@
+// offlinedb.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "acoustid.h"
+
+class MappedFile;
+
+// Local fingerprint database for identification without network access. It is imported
+// from a json lines dataset into a single file of records, decoded sub-fingerprints and an
+// inverted index over them, which is memory-mapped read-only for lookups.
+class OfflineDb
+{
+public:
+  static bool Init(const std::string& p_Path);
+  static void Cleanup();
+  static bool IsEnabled();
+  static void Lookup(const AcoustId::Fingerprint& p_Fingerprint,
+                     std::vector<AcoustId::Match>& p_Matches);
+  static bool Import(const std::string& p_DatasetPath, const std::string& p_Path,
+                     size_t& p_Count);
+
+private:
+  static bool Validate(const char* p_Data, size_t p_Size);
+
+private:
+  static std::unique_ptr<MappedFile> m_File;
+};
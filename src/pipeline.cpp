@@ -0,0 +1,673 @@
+// pipeline.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "pipeline.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <nlohmann/json.hpp>
+
+#include "editor.h"
+#include "fpcache.h"
+#include "journal.h"
+#include "log.h"
+#include "nameindex.h"
+#include "scanner.h"
+#include "sniffer.h"
+#include "statedb.h"
+#include "stats.h"
+#include "tag.h"
+#include "util.h"
+
+static const std::set<std::string> s_Extensions = { ".mp3" };
+
+// Shorter tracks rarely produce fingerprints that can be matched
+static const int s_MinDetectDurationSec = 10;
+
+// Share of equal fingerprint bits for two files to be considered the same recording,
+// unrelated audio is typically around one half
+static const double s_MinDuplicateSimilarity = 0.8;
+
+static const std::set<std::string> s_StageNames =
+{
+  "scan", "read", "fingerprint", "lookup", "edit", "write", "rename"
+};
+
+// Directory listing and lookup workers mostly wait on storage and network
+static const int s_MinScanWorkers = 4;
+static const int s_MinLookupWorkers = 16;
+
+// Operations recorded with the incremental state, so that a file passed by other operations
+// is processed again
+static uint32_t GetOperations(const Pipeline::Options& p_Options)
+{
+  return (p_Options.clear ? 0x1 : 0) | (p_Options.detect ? 0x2 : 0) |
+         (p_Options.edit ? 0x4 : 0) | (p_Options.rename ? 0x8 : 0);
+}
+
+Pipeline::Pipeline(const Options& p_Options)
+  : m_Options(p_Options)
+  , m_Planning(!p_Options.planPath.empty())
+  , m_Applying(!p_Options.applyPath.empty())
+  , m_ReportQueue(64)
+{
+  const int jobs = m_Options.jobs;
+  const bool modify = m_Options.detect || m_Options.edit || m_Options.rename;
+
+  AddStage("read", jobs, [this](Item& p_Item) { ReadTags(p_Item); });
+
+  if (m_Options.findDuplicates)
+  {
+    AddStage("fingerprint", jobs, [this](Item& p_Item) { Fingerprint(p_Item); });
+  }
+
+  if (m_Options.detect)
+  {
+    AddStage("fingerprint", jobs, [this](Item& p_Item) { Fingerprint(p_Item); });
+    AddStage("lookup", std::max(jobs, s_MinLookupWorkers),
+             [this](Item& p_Item) { Lookup(p_Item); });
+  }
+
+  if (m_Options.edit)
+  {
+    AddStage("edit", 1, [this](Item& p_Item) { Edit(p_Item); });
+  }
+
+  // Plans leave files untouched, applied plans hold the operations for each file
+  if (!m_Planning && (m_Options.clear || modify || m_Applying))
+  {
+    AddStage("write", jobs, [this](Item& p_Item) { WriteTags(p_Item); });
+  }
+
+  if (m_Options.rename || m_Applying)
+  {
+    AddStage("rename", jobs, [this](Item& p_Item) { RenameFile(p_Item); });
+  }
+
+  std::vector<std::string> stageNames;
+  for (const auto& stage : m_Stages)
+  {
+    stageNames.push_back(stage->name);
+  }
+
+  m_Reporter.reset(new Reporter(m_Options.reportFormat, m_Options.reportJson, stageNames));
+
+  // Interactive editing handles one file at a time from start to end
+  m_MaxInFlight = m_Options.edit ? 1 : SIZE_MAX;
+}
+
+bool Pipeline::Run(const std::vector<std::string>& p_Paths)
+{
+  if (m_Planning)
+  {
+    m_PlanFile.open(m_Options.planPath, std::ios::trunc);
+    if (!m_PlanFile)
+    {
+      std::cerr << "ERROR: Failed to write plan '" << m_Options.planPath << "'\n";
+      return false;
+    }
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < m_Stages.size(); ++i)
+  {
+    Stage& stage = *m_Stages[i];
+    stage.active = stage.workers;
+    for (int worker = 0; worker < stage.workers; ++worker)
+    {
+      threads.emplace_back(&Pipeline::RunStage, this, i);
+    }
+  }
+
+  if (m_Applying)
+  {
+    threads.emplace_back(&Pipeline::LoadPlan, this);
+  }
+  else
+  {
+    threads.emplace_back(&Pipeline::Scan, this, std::cref(p_Paths));
+  }
+
+  std::thread monitorThread;
+  if (Log::GetVerbose())
+  {
+    monitorThread = std::thread(&Pipeline::Monitor, this);
+  }
+
+  const bool result = Report();
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  if (m_Options.findDuplicates)
+  {
+    OutputDuplicates();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Done = true;
+    m_Cond.notify_all();
+  }
+
+  if (monitorThread.joinable())
+  {
+    monitorThread.join();
+  }
+
+  return result;
+}
+
+bool Pipeline::ParseStageJobs(const std::string& p_Str, std::map<std::string, int>& p_StageJobs)
+{
+  std::istringstream iss(p_Str);
+  std::string entry;
+  while (std::getline(iss, entry, ','))
+  {
+    const size_t pos = entry.find('=');
+    if (pos == std::string::npos)
+    {
+      return false;
+    }
+
+    const std::string name = entry.substr(0, pos);
+    int workers = 0;
+    if (!Util::ToInt(entry.substr(pos + 1), workers) || (workers < 1) ||
+        (s_StageNames.find(name) == s_StageNames.end()))
+    {
+      return false;
+    }
+
+    p_StageJobs[name] = workers;
+  }
+
+  return true;
+}
+
+void Pipeline::AddStage(const std::string& p_Name, int p_Workers,
+                        const std::function<void(Item&)>& p_Func)
+{
+  auto it = m_Options.stageJobs.find(p_Name);
+  std::unique_ptr<Stage> stage(new Stage());
+  stage->name = p_Name;
+  stage->timerName = "stage." + p_Name;
+  stage->workers = (it != m_Options.stageJobs.end()) ? it->second : p_Workers;
+  stage->func = p_Func;
+  stage->queue.reset(new BoundedQueue<ItemPtr>(std::max<size_t>(16, 2 * stage->workers)));
+  m_Stages.push_back(std::move(stage));
+}
+
+void Pipeline::Scan(const std::vector<std::string>& p_Paths)
+{
+  auto it = m_Options.stageJobs.find("scan");
+  const int workers = (it != m_Options.stageJobs.end()) ? it->second
+                                                       : std::max(m_Options.jobs, s_MinScanWorkers);
+  Scanner::Filter filter;
+  if (m_Options.sniff || m_Options.incremental || (m_Options.sinceSec > 0))
+  {
+    const int minDurationSec =
+      (m_Options.detect || m_Options.findDuplicates) ? s_MinDetectDurationSec : 0;
+    filter = [this, minDurationSec](int p_DirFd, const std::string& p_Name)
+    {
+      return IsChanged(p_DirFd, p_Name) &&
+             (!m_Options.sniff || Sniffer::Check(p_DirFd, p_Name, minDurationSec));
+    };
+  }
+
+  // Files given as paths are not sniffed, but skipped when unchanged like those in directories
+  std::vector<std::string> paths;
+  for (const auto& path : p_Paths)
+  {
+    struct stat st;
+    if ((stat(path.c_str(), &st) == 0) && S_ISREG(st.st_mode) && !IsChanged(AT_FDCWD, path))
+    {
+      Log::Debug("scan skipped %s", path.c_str());
+      Stats::AddCount("scan.skipped");
+      continue;
+    }
+
+    paths.push_back(path);
+  }
+
+  Scanner scanner(workers, s_Extensions, filter);
+  scanner.Scan(paths, [&](const std::string& p_FilePath)
+  {
+    ItemPtr item(new Item());
+    item->filePath = p_FilePath;
+    item->newFilePath = p_FilePath;
+    item->clear = m_Options.clear;
+    item->modify = m_Options.detect || m_Options.edit || m_Options.rename;
+    item->rename = m_Options.rename;
+    Push(std::move(item));
+  });
+
+  m_Stages.front()->queue->Close();
+}
+
+bool Pipeline::IsChanged(int p_DirFd, const std::string& p_Name)
+{
+  if (!m_Options.incremental && (m_Options.sinceSec == 0))
+  {
+    return true;
+  }
+
+  // Files that cannot be checked are left for the later stages to report
+  struct stat st;
+  if (fstatat(p_DirFd, p_Name.c_str(), &st, 0) != 0)
+  {
+    return true;
+  }
+
+  if ((m_Options.sinceSec > 0) && (StateDb::GetMtimeNs(st) < (m_Options.sinceSec * 1000000000)))
+  {
+    return false;
+  }
+
+  if (m_Options.incremental && StateDb::IsUnchanged(st, GetOperations(m_Options)))
+  {
+    Stats::AddCount("state.unchanged");
+    return false;
+  }
+
+  return true;
+}
+
+void Pipeline::LoadPlan()
+{
+  // Entries hold the operations for one file each, failed entries are left out
+  std::ifstream file(m_Options.applyPath);
+  std::string line;
+  while (std::getline(file, line))
+  {
+    const nlohmann::json entry = nlohmann::json::parse(line, nullptr, false /*allow_exceptions*/);
+    if (entry.is_discarded() || !entry.is_object() || !entry.value("result", false) ||
+        !entry.value("path", nlohmann::json()).is_string())
+    {
+      Log::Debug("skip plan entry %s", line.c_str());
+      continue;
+    }
+
+    ItemPtr item(new Item());
+    item->filePath = entry["path"].get<std::string>();
+    item->newFilePath = item->filePath;
+    item->clear = entry.value("clear", false);
+    if (entry.value("artist", nlohmann::json()).is_string() &&
+        entry.value("title", nlohmann::json()).is_string())
+    {
+      item->artist = entry["artist"].get<std::string>();
+      item->title = entry["title"].get<std::string>();
+      item->modify = true;
+    }
+
+    if (entry.value("target", nlohmann::json()).is_string())
+    {
+      item->newFilePath = entry["target"].get<std::string>();
+      item->rename = true;
+    }
+
+    Push(std::move(item));
+  }
+
+  m_Stages.front()->queue->Close();
+}
+
+void Pipeline::Push(ItemPtr p_Item)
+{
+  // Files completed by an interrupted run are left out when resuming it
+  if (Journal::IsDone(p_Item->filePath))
+  {
+    Stats::AddCount("journal.skipped");
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Cond.wait(lock, [&]() { return m_InFlight < m_MaxInFlight; });
+    ++m_InFlight;
+  }
+
+  p_Item->index = m_Pushed++;
+  p_Item->stageSec.assign(m_Stages.size(), -1.0);
+  p_Item->startTime = std::chrono::steady_clock::now();
+  m_Stages.front()->queue->Push(std::move(p_Item));
+}
+
+void Pipeline::RunStage(size_t p_Index)
+{
+  Stage& stage = *m_Stages[p_Index];
+  ItemPtr item;
+  while (stage.queue->Pop(item))
+  {
+    ++stage.busy;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    stage.func(*item);
+    const double elapsedSec = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    Stats::AddTime(stage.timerName.c_str(), elapsedSec);
+    item->stageSec[p_Index] = elapsedSec;
+    --stage.busy;
+    Forward(p_Index + 1, std::move(item));
+  }
+
+  // Last worker out closes the next stage, which then drains and closes its successor
+  if (--stage.active == 0)
+  {
+    if ((p_Index + 1) < m_Stages.size())
+    {
+      m_Stages[p_Index + 1]->queue->Close();
+    }
+    else
+    {
+      m_ReportQueue.Close();
+    }
+  }
+}
+
+void Pipeline::Forward(size_t p_Index, ItemPtr p_Item)
+{
+  // Failed files skip remaining stages
+  if (p_Item->result && (p_Index < m_Stages.size()))
+  {
+    m_Stages[p_Index]->queue->Push(std::move(p_Item));
+  }
+  else
+  {
+    m_ReportQueue.Push(std::move(p_Item));
+  }
+}
+
+bool Pipeline::Report()
+{
+  bool resultAll = true;
+  size_t nextReport = 0;
+  std::map<size_t, ItemPtr> pending;
+  ItemPtr item;
+  while (m_ReportQueue.Pop(item))
+  {
+    resultAll = resultAll && item->result;
+    Stats::AddCount(item->result ? "files.pass" : "files.fail");
+    item->totalSec = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - item->startTime).count();
+    Stats::AddTime("file.total", item->totalSec);
+    Journal::Add(item->filePath, item->newFilePath, item->result);
+    if (m_Options.incremental && !m_Planning)
+    {
+      StateDb::Set(item->newFilePath, item->result, GetOperations(m_Options));
+    }
+
+    if (m_Options.unordered)
+    {
+      Output(*item);
+    }
+    else
+    {
+      // Hold back files until all files before them are reported
+      pending[item->index] = std::move(item);
+      for (auto it = pending.begin(); (it != pending.end()) && (it->first == nextReport);
+           it = pending.erase(it), ++nextReport)
+      {
+        Output(*it->second);
+      }
+    }
+
+    // Reports are written once no more are ready, so that none waits for the next file to
+    // finish, and interactive editing shows each result before the next file
+    if (m_Options.edit || (m_ReportQueue.Size() == 0))
+    {
+      m_Reporter->Flush();
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    --m_InFlight;
+    m_Cond.notify_all();
+  }
+
+  m_Reporter->Flush();
+  return resultAll;
+}
+
+void Pipeline::Output(const Item& p_Item)
+{
+  // Duplicates are reported as groups at the end, failed files are only logged
+  if (m_Options.findDuplicates)
+  {
+    if (p_Item.result)
+    {
+      m_FpIndex.Add(m_FpIndexPaths.size(), p_Item.subFingerprints);
+      m_FpIndexPaths.push_back(p_Item.filePath);
+    }
+    else
+    {
+      Log::Debug("fingerprint failed for %s", p_Item.filePath.c_str());
+    }
+
+    return;
+  }
+
+  Reporter::Record record;
+  record.filePath = p_Item.filePath;
+  record.newFilePath = p_Item.newFilePath;
+  record.artist = p_Item.artist;
+  record.title = p_Item.title;
+  record.result = p_Item.result;
+  record.detected = m_Options.detect;
+  record.score = p_Item.score;
+  record.fpCache = p_Item.fpCache;
+  record.lookupCache = p_Item.lookupCache;
+  record.stageSec = &p_Item.stageSec;
+  record.totalSec = p_Item.totalSec;
+  m_Reporter->Write(record);
+
+  if (m_Planning)
+  {
+    nlohmann::json entry;
+    entry["path"] = p_Item.filePath;
+    entry["result"] = p_Item.result;
+    entry["clear"] = p_Item.clear;
+    if (p_Item.modify)
+    {
+      entry["artist"] = p_Item.artist;
+      entry["title"] = p_Item.title;
+    }
+
+    if (m_Options.detect)
+    {
+      entry["score"] = p_Item.score;
+    }
+
+    if (p_Item.rename)
+    {
+      entry["target"] = p_Item.newFilePath;
+    }
+
+    m_PlanFile << entry.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << "\n";
+  }
+}
+
+void Pipeline::OutputDuplicates()
+{
+  // Groups are listed one file per line and separated by empty lines, or as json arrays
+  std::vector<std::vector<size_t>> groups;
+  m_FpIndex.FindDuplicates(s_MinDuplicateSimilarity, groups);
+  Stats::AddCount("dup.groups", static_cast<int64_t>(groups.size()));
+  for (size_t i = 0; i < groups.size(); ++i)
+  {
+    if (m_Options.reportJson)
+    {
+      nlohmann::json entry;
+      for (const size_t id : groups[i])
+      {
+        entry["duplicates"].push_back(m_FpIndexPaths[id]);
+      }
+
+      std::cout << entry.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << "\n";
+    }
+    else
+    {
+      std::cout << ((i > 0) ? "\n" : "");
+      for (const size_t id : groups[i])
+      {
+        std::cout << m_FpIndexPaths[id] << "\n";
+      }
+    }
+  }
+
+  std::cout << std::flush;
+}
+
+void Pipeline::Monitor()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while (!m_Cond.wait_for(lock, std::chrono::seconds(1), [&]() { return m_Done; }))
+  {
+    std::ostringstream oss;
+    for (const auto& stage : m_Stages)
+    {
+      oss << " " << stage->name << " " << stage->queue->Size() << "/" << stage->queue->Capacity()
+          << " " << stage->busy << "/" << stage->workers;
+    }
+
+    oss << " report " << m_ReportQueue.Size() << "/" << m_ReportQueue.Capacity();
+    Log::Debug("pipeline%s", oss.str().c_str());
+  }
+}
+
+void Pipeline::ReadTags(Item& p_Item)
+{
+  const std::string ext = Util::ToLower(Util::GetFileExt(p_Item.filePath));
+  if (s_Extensions.find(ext) == s_Extensions.end())
+  {
+    p_Item.result = false;
+    return;
+  }
+
+  // One mapping of the file serves both the tag parser and the fingerprint decoder
+  std::shared_ptr<MappedFile> mappedFile = std::make_shared<MappedFile>();
+  if (!mappedFile->Open(p_Item.filePath))
+  {
+    mappedFile.reset();
+  }
+
+  // Finding duplicates only needs the audio
+  if (m_Options.findDuplicates)
+  {
+    p_Item.mappedFile = mappedFile;
+    return;
+  }
+
+  // The file stays open and parsed until the write stage saves it
+  p_Item.mappedFile = m_Options.detect ? mappedFile : nullptr;
+  p_Item.result = p_Item.tagSession.Open(p_Item.filePath, mappedFile);
+  if (p_Item.result && p_Item.clear)
+  {
+    p_Item.tagSession.Clear();
+  }
+
+  // Applied plans already hold the tags to write
+  if (p_Item.result && p_Item.modify && !m_Applying)
+  {
+    p_Item.tagSession.Read(p_Item.artist, p_Item.title);
+    p_Item.result = m_Options.detect || m_Options.edit ||
+                    (!p_Item.artist.empty() && !p_Item.title.empty());
+  }
+
+  // Plans are never saved, so the cleared tags above only affect what is read
+  if (m_Planning)
+  {
+    p_Item.tagSession.Close();
+  }
+}
+
+void Pipeline::Fingerprint(Item& p_Item)
+{
+  p_Item.result = AcoustId::GetFingerprint(p_Item.filePath, p_Item.mappedFile.get(),
+                                           p_Item.fingerprint);
+  p_Item.mappedFile.reset();
+  p_Item.fpCache = p_Item.fingerprint.cached ? "hit" : "miss";
+  if (p_Item.result && m_Options.findDuplicates)
+  {
+    p_Item.result = FpIndex::Decode(p_Item.fingerprint.fp, p_Item.subFingerprints);
+  }
+}
+
+void Pipeline::Lookup(Item& p_Item)
+{
+  AcoustId::Match match;
+  p_Item.result = AcoustId::LookupMatch(p_Item.fingerprint, match);
+  p_Item.lookupCache = match.cached ? "hit" : "miss";
+  if (p_Item.result)
+  {
+    p_Item.artist = match.artist;
+    p_Item.title = match.title;
+    p_Item.score = match.score;
+  }
+}
+
+void Pipeline::Edit(Item& p_Item)
+{
+  p_Item.result = Editor::Edit(p_Item.filePath, p_Item.artist, p_Item.title);
+}
+
+void Pipeline::WriteTags(Item& p_Item)
+{
+  if (p_Item.modify)
+  {
+    p_Item.result = p_Item.tagSession.Write(p_Item.artist, p_Item.title);
+  }
+
+  // Tag updates change the file identity but not its audio, so keep its cached fingerprint
+  FpCache::Key oldKey;
+  const bool hasOldKey = FpCache::GetKey(p_Item.filePath, oldKey);
+  p_Item.result = p_Item.result && p_Item.tagSession.Save(m_Options.padding);
+  p_Item.tagSession.Close();
+
+  FpCache::Key newKey;
+  if (p_Item.result && hasOldKey && FpCache::GetKey(p_Item.filePath, newKey))
+  {
+    FpCache::Rekey(oldKey, newKey);
+  }
+}
+
+void Pipeline::RenameFile(Item& p_Item)
+{
+  if (!p_Item.rename)
+  {
+    return;
+  }
+
+  // A planned name stays reserved, so names proposed within one plan do not collide
+  if (m_Planning)
+  {
+    p_Item.newFilePath = Tag::MakePath(p_Item.filePath, p_Item.artist, p_Item.title);
+    return;
+  }
+
+  // Names are reserved in the index, and the rename itself fails rather than replace a file
+  // created outside of it, in which case that name stays taken and the next one is tried
+  const std::filesystem::path target(p_Item.newFilePath);
+  bool exists = true;
+  while (exists)
+  {
+    p_Item.newFilePath = m_Applying
+      ? NameIndex::Reserve(target.parent_path().string(), target.stem().string(),
+                           target.extension().string())
+      : Tag::MakePath(p_Item.filePath, p_Item.artist, p_Item.title);
+    p_Item.result = Util::RenameNoReplace(p_Item.filePath, p_Item.newFilePath, exists);
+  }
+
+  NameIndex::Release(p_Item.result ? p_Item.filePath : p_Item.newFilePath);
+}
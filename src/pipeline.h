@@ -0,0 +1,134 @@
+// pipeline.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "acoustid.h"
+#include "boundedqueue.h"
+#include "fpindex.h"
+#include "mappedfile.h"
+#include "reporter.h"
+#include "tagsession.h"
+
+// Processes files in stages (read, fingerprint, lookup, edit, write, rename) connected
+// by bounded queues, each stage served by its own pool of worker threads. A plan run
+// records the proposed changes as JSON lines without modifying files, and an apply run
+// performs only the writes and renames of such a plan. Finding duplicates only reads and
+// fingerprints files, and reports groups of the same recording once all are processed.
+class Pipeline
+{
+public:
+  struct Options
+  {
+    bool clear = false;
+    bool detect = false;
+    bool edit = false;
+    bool findDuplicates = false;
+    bool rename = false;
+    bool sniff = false;
+    bool incremental = false;
+    bool unordered = false;
+    int jobs = 1;
+    int padding = 0;
+    int64_t sinceSec = 0;
+    std::map<std::string, int> stageJobs;
+    std::string reportFormat;
+    bool reportJson = false;
+    std::string planPath;
+    std::string applyPath;
+  };
+
+public:
+  explicit Pipeline(const Options& p_Options);
+  bool Run(const std::vector<std::string>& p_Paths);
+  static bool ParseStageJobs(const std::string& p_Str, std::map<std::string, int>& p_StageJobs);
+
+private:
+  struct Item
+  {
+    size_t index = 0;
+    std::chrono::steady_clock::time_point startTime;
+    std::string filePath;
+    std::string newFilePath;
+    std::string artist;
+    std::string title;
+    double score = 0.0;
+    bool clear = false;
+    bool modify = false;
+    bool rename = false;
+    const char* fpCache = nullptr;
+    const char* lookupCache = nullptr;
+    std::vector<double> stageSec;
+    double totalSec = 0.0;
+    AcoustId::Fingerprint fingerprint;
+    std::vector<uint32_t> subFingerprints;
+    std::shared_ptr<MappedFile> mappedFile;
+    TagSession tagSession;
+    bool result = true;
+  };
+
+  typedef std::unique_ptr<Item> ItemPtr;
+
+  struct Stage
+  {
+    std::string name;
+    std::string timerName;
+    int workers = 1;
+    std::function<void(Item&)> func;
+    std::unique_ptr<BoundedQueue<ItemPtr>> queue;
+    std::atomic<int> active = { 0 };
+    std::atomic<int> busy = { 0 };
+  };
+
+  void AddStage(const std::string& p_Name, int p_Workers, const std::function<void(Item&)>& p_Func);
+  void Scan(const std::vector<std::string>& p_Paths);
+  bool IsChanged(int p_DirFd, const std::string& p_Name);
+  void LoadPlan();
+  void Push(ItemPtr p_Item);
+  void RunStage(size_t p_Index);
+  void Forward(size_t p_Index, ItemPtr p_Item);
+  bool Report();
+  void Output(const Item& p_Item);
+  void OutputDuplicates();
+  void Monitor();
+
+  void ReadTags(Item& p_Item);
+  void Fingerprint(Item& p_Item);
+  void Lookup(Item& p_Item);
+  void Edit(Item& p_Item);
+  void WriteTags(Item& p_Item);
+  void RenameFile(Item& p_Item);
+
+private:
+  Options m_Options;
+  bool m_Planning = false;
+  bool m_Applying = false;
+  std::ofstream m_PlanFile;
+  std::unique_ptr<Reporter> m_Reporter;
+  FpIndex m_FpIndex;
+  std::vector<std::string> m_FpIndexPaths;
+  std::vector<std::unique_ptr<Stage>> m_Stages;
+  BoundedQueue<ItemPtr> m_ReportQueue;
+  size_t m_Pushed = 0;
+  size_t m_MaxInFlight = 0;
+  size_t m_InFlight = 0;
+  bool m_Done = false;
+  std::mutex m_Mutex;
+  std::condition_variable m_Cond;
+};
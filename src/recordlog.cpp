@@ -0,0 +1,190 @@
+// recordlog.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "recordlog.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.h"
+
+RecordLog::RecordLog(const char* p_Name, const char* p_Magic)
+  : m_Name(p_Name)
+  , m_Magic(p_Magic)
+{
+}
+
+RecordLog::~RecordLog()
+{
+  Close();
+}
+
+bool RecordLog::Open(const std::string& p_Path, bool p_Truncate, const Reader& p_Reader)
+{
+  Close();
+  m_Path = p_Path;
+  const int flags = O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC | (p_Truncate ? O_TRUNC : 0);
+  m_Fd = open(m_Path.c_str(), flags, 0644);
+  if (m_Fd == -1)
+  {
+    Log::Debug("%s open failed (%s)", m_Name.c_str(), m_Path.c_str());
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(m_Fd, &st) != 0)
+  {
+    Close();
+    return false;
+  }
+
+  if (st.st_size == 0)
+  {
+    if (write(m_Fd, m_Magic, MagicSize) != static_cast<ssize_t>(MagicSize))
+    {
+      Close();
+      return false;
+    }
+
+    return true;
+  }
+
+  m_MapSize = static_cast<size_t>(st.st_size);
+  void* map = mmap(nullptr, m_MapSize, PROT_READ, MAP_SHARED, m_Fd, 0);
+  if (map == MAP_FAILED)
+  {
+    m_MapSize = 0;
+    Close();
+    return false;
+  }
+
+  m_Map = static_cast<const char*>(map);
+  if ((m_MapSize < MagicSize) || (memcmp(m_Map, m_Magic, MagicSize) != 0))
+  {
+    Log::Debug("%s invalid (%s)", m_Name.c_str(), m_Path.c_str());
+    Close();
+    return false;
+  }
+
+  size_t offset = MagicSize;
+  while (offset < m_MapSize)
+  {
+    const size_t size = p_Reader(m_Map + offset, m_MapSize - offset, offset);
+    if (size == 0)
+    {
+      break;
+    }
+
+    offset += size;
+  }
+
+  // Drop a partially written trailing record, e.g. from an interrupted run. Records are
+  // located by their sizes only, so a corrupt size also drops all valid records after it.
+  if (offset != m_MapSize)
+  {
+    Log::Debug("%s truncated at %zu", m_Name.c_str(), offset);
+    if (ftruncate(m_Fd, static_cast<off_t>(offset)) != 0)
+    {
+      Close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void RecordLog::Close()
+{
+  if (m_Map != nullptr)
+  {
+    munmap(const_cast<char*>(m_Map), m_MapSize);
+    m_Map = nullptr;
+    m_MapSize = 0;
+  }
+
+  if (m_Fd != -1)
+  {
+    close(m_Fd);
+    m_Fd = -1;
+  }
+
+  m_DeadCount = 0;
+}
+
+bool RecordLog::IsOpen() const
+{
+  return (m_Fd != -1);
+}
+
+const char* RecordLog::GetData() const
+{
+  return m_Map;
+}
+
+bool RecordLog::Append(const void* p_Data, size_t p_Size)
+{
+  if (write(m_Fd, p_Data, p_Size) != static_cast<ssize_t>(p_Size))
+  {
+    Log::Debug("%s write failed", m_Name.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+void RecordLog::Sync()
+{
+  if (m_Fd != -1)
+  {
+    fsync(m_Fd);
+  }
+}
+
+void RecordLog::AddSuperseded()
+{
+  ++m_DeadCount;
+}
+
+bool RecordLog::NeedsCompact(size_t p_LiveCount) const
+{
+  // Rewrite the log when mostly made up of superseded records
+  return (m_DeadCount > 1024) && (m_DeadCount > p_LiveCount);
+}
+
+bool RecordLog::Compact(const Writer& p_Writer)
+{
+  const std::string tmpPath = m_Path + ".tmp";
+  const int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1)
+  {
+    return false;
+  }
+
+  // The writer appends to the new log, while the mapping of the current one stays readable
+  const int appendFd = m_Fd;
+  m_Fd = fd;
+  bool written = (write(fd, m_Magic, MagicSize) == static_cast<ssize_t>(MagicSize)) &&
+                 p_Writer();
+  written = written && (fsync(fd) == 0);
+  close(fd);
+  m_Fd = appendFd;
+  if (!written || (rename(tmpPath.c_str(), m_Path.c_str()) != 0))
+  {
+    unlink(tmpPath.c_str());
+    return false;
+  }
+
+  // Closed as the renamed log replaces the one open, so that it is opened again by the owner
+  Log::Debug("%s compacted %zu records", m_Name.c_str(), m_DeadCount);
+  Close();
+  return true;
+}
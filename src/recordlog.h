@@ -0,0 +1,54 @@
+// recordlog.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Append-only log of records after a magic header, shared by the binary caches and the
+// journal. On open the log is memory-mapped read-only and its records are passed to a reader,
+// dropping a partially written trailing record, or everything from a record of invalid size.
+// The log can be rewritten from the records still in use once mostly made up of superseded
+// ones.
+class RecordLog
+{
+public:
+  // Returns the size of the record at p_Data, or zero if it is incomplete
+  typedef std::function<size_t(const char* p_Data, size_t p_Size, size_t p_Offset)> Reader;
+
+  // Appends all records still in use, returns false on failure
+  typedef std::function<bool()> Writer;
+
+public:
+  RecordLog(const char* p_Name, const char* p_Magic);
+  ~RecordLog();
+  RecordLog(const RecordLog&) = delete;
+  RecordLog& operator=(const RecordLog&) = delete;
+
+  bool Open(const std::string& p_Path, bool p_Truncate, const Reader& p_Reader);
+  void Close();
+  bool IsOpen() const;
+  const char* GetData() const;
+  bool Append(const void* p_Data, size_t p_Size);
+  void Sync();
+  void AddSuperseded();
+  bool NeedsCompact(size_t p_LiveCount) const;
+  bool Compact(const Writer& p_Writer);
+
+private:
+  static const size_t MagicSize = 8;
+
+  std::string m_Name;
+  const char* m_Magic = nullptr;
+  std::string m_Path;
+  int m_Fd = -1;
+  const char* m_Map = nullptr;
+  size_t m_MapSize = 0;
+  size_t m_DeadCount = 0;
+};
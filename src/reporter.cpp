@@ -0,0 +1,279 @@
+// reporter.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "reporter.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "util.h"
+
+// Reports written back to back are held back until the buffer fills up, or for at most this
+// long, the writer flushes when it runs out of reports
+static const size_t s_FlushSize = 64 * 1024;
+static const std::chrono::seconds s_FlushInterval(1);
+
+Reporter::Reporter(const std::string& p_Format, bool p_Json,
+                   const std::vector<std::string>& p_StageNames)
+  : m_Json(p_Json)
+  , m_Immediate(isatty(fileno(stdout)) != 0)
+  , m_StageNames(p_StageNames)
+  , m_FlushTime(std::chrono::steady_clock::now())
+{
+  // Unknown fields are kept as text
+  for (size_t i = 0; i < p_Format.size(); ++i)
+  {
+    Field field = Text;
+    if ((p_Format[i] == '%') && ((i + 1) < p_Format.size()))
+    {
+      switch (p_Format[i + 1])
+      {
+        case 'i': field = InputPath; break;
+        case 'o': field = OutputPath; break;
+        case 'r': field = Result; break;
+        case 'a': field = Artist; break;
+        case 't': field = Title; break;
+        case 's': field = Score; break;
+        case 'f': field = FpCache; break;
+        case 'l': field = LookupCache; break;
+        case 'S': field = StageTimes; break;
+        case 'T': field = TotalTime; break;
+        default: break;
+      }
+    }
+
+    if (field != Text)
+    {
+      Token token;
+      token.field = field;
+      m_Tokens.push_back(token);
+      ++i;
+    }
+    else if (!m_Tokens.empty() && (m_Tokens.back().field == Text))
+    {
+      m_Tokens.back().text += p_Format[i];
+    }
+    else
+    {
+      Token token;
+      token.text = p_Format[i];
+      m_Tokens.push_back(token);
+    }
+  }
+
+  m_Buffer.reserve(s_FlushSize);
+}
+
+Reporter::~Reporter()
+{
+  Flush();
+}
+
+void Reporter::Write(const Record& p_Record)
+{
+  const size_t size = m_Buffer.size();
+  Format(p_Record, m_Buffer);
+  if (m_Buffer.size() == size)
+  {
+    return;
+  }
+
+  m_Buffer += '\n';
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (m_Immediate || (m_Buffer.size() >= s_FlushSize) || ((now - m_FlushTime) >= s_FlushInterval))
+  {
+    Flush();
+  }
+}
+
+void Reporter::Flush()
+{
+  if (!m_Buffer.empty())
+  {
+    fwrite(m_Buffer.data(), 1, m_Buffer.size(), stdout);
+    fflush(stdout);
+    m_Buffer.clear();
+  }
+
+  m_FlushTime = std::chrono::steady_clock::now();
+}
+
+void Reporter::Format(const Record& p_Record, std::string& p_Out) const
+{
+  if (m_Json)
+  {
+    FormatJson(p_Record, p_Out);
+  }
+  else
+  {
+    FormatText(p_Record, p_Out);
+  }
+}
+
+void Reporter::FormatText(const Record& p_Record, std::string& p_Out) const
+{
+  for (const Token& token : m_Tokens)
+  {
+    switch (token.field)
+    {
+      case Text:
+        p_Out += token.text;
+        break;
+
+      case InputPath:
+        p_Out += p_Record.filePath;
+        break;
+
+      case OutputPath:
+        p_Out += p_Record.newFilePath;
+        break;
+
+      case Result:
+        p_Out += p_Record.result ? "PASS" : "FAIL";
+        break;
+
+      case Artist:
+        p_Out += p_Record.artist;
+        break;
+
+      case Title:
+        p_Out += p_Record.title;
+        break;
+
+      case Score:
+        AppendNumber(p_Record.score, p_Out);
+        break;
+
+      case FpCache:
+        p_Out += (p_Record.fpCache != nullptr) ? p_Record.fpCache : "-";
+        break;
+
+      case LookupCache:
+        p_Out += (p_Record.lookupCache != nullptr) ? p_Record.lookupCache : "-";
+        break;
+
+      case StageTimes:
+        AppendStageTimes(p_Record, "", "=", p_Out);
+        break;
+
+      case TotalTime:
+        AppendNumber(p_Record.totalSec * 1000.0, p_Out);
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+void Reporter::FormatJson(const Record& p_Record, std::string& p_Out) const
+{
+  p_Out += "{\"input\":";
+  AppendJsonString(p_Record.filePath, p_Out);
+  p_Out += ",\"output\":";
+  AppendJsonString(p_Record.newFilePath, p_Out);
+  p_Out += ",\"result\":";
+  p_Out += p_Record.result ? "true" : "false";
+  p_Out += ",\"artist\":";
+  AppendJsonString(p_Record.artist, p_Out);
+  p_Out += ",\"title\":";
+  AppendJsonString(p_Record.title, p_Out);
+  if (p_Record.detected)
+  {
+    p_Out += ",\"score\":";
+    AppendNumber(p_Record.score, p_Out);
+  }
+
+  if (p_Record.fpCache != nullptr)
+  {
+    p_Out += ",\"fpcache\":\"";
+    p_Out += p_Record.fpCache;
+    p_Out += '"';
+  }
+
+  if (p_Record.lookupCache != nullptr)
+  {
+    p_Out += ",\"lookupcache\":\"";
+    p_Out += p_Record.lookupCache;
+    p_Out += '"';
+  }
+
+  p_Out += ",\"stage_ms\":{";
+  AppendStageTimes(p_Record, "\"", "\":", p_Out);
+  p_Out += "},\"total_ms\":";
+  AppendNumber(p_Record.totalSec * 1000.0, p_Out);
+  p_Out += '}';
+}
+
+void Reporter::AppendStageTimes(const Record& p_Record, const char* p_Quote,
+                                const char* p_Separator, std::string& p_Out) const
+{
+  // Stages not reached, e.g. after a failure, are left out
+  bool first = true;
+  for (size_t i = 0; (p_Record.stageSec != nullptr) && (i < p_Record.stageSec->size()); ++i)
+  {
+    if (p_Record.stageSec->at(i) < 0.0)
+    {
+      continue;
+    }
+
+    p_Out += first ? "" : ",";
+    p_Out += p_Quote;
+    p_Out += m_StageNames.at(i);
+    p_Out += p_Separator;
+    AppendNumber(p_Record.stageSec->at(i) * 1000.0, p_Out);
+    first = false;
+  }
+}
+
+void Reporter::AppendJsonString(std::string_view p_Str, std::string& p_Out)
+{
+  static const char* hex = "0123456789abcdef";
+
+  // Invalid UTF-8, e.g. file names in a legacy encoding, is replaced to keep the json valid
+  std::string valid;
+  if (std::any_of(p_Str.begin(), p_Str.end(), [](char p_Char) { return (p_Char & 0x80) != 0; }))
+  {
+    valid = Util::ToValidUtf8(std::string(p_Str));
+    p_Str = valid;
+  }
+
+  p_Out += '"';
+  for (const char ch : p_Str)
+  {
+    const unsigned char uch = static_cast<unsigned char>(ch);
+    if ((ch == '"') || (ch == '\\'))
+    {
+      p_Out += '\\';
+      p_Out += ch;
+    }
+    else if (uch < 0x20)
+    {
+      p_Out += "\\u00";
+      p_Out += hex[uch >> 4];
+      p_Out += hex[uch & 0xf];
+    }
+    else
+    {
+      p_Out += ch;
+    }
+  }
+
+  p_Out += '"';
+}
+
+void Reporter::AppendNumber(double p_Value, std::string& p_Out)
+{
+  char buf[32];
+  const int len = snprintf(buf, sizeof(buf), "%.3f", p_Value);
+  if (len > 0)
+  {
+    p_Out.append(buf, static_cast<size_t>(len));
+  }
+}
@@ -0,0 +1,78 @@
+// reporter.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Writes one report per file, either as text from a format parsed once into tokens, or as
+// json lines. Reports are buffered and written to stdout in blocks, unless it is a terminal.
+class Reporter
+{
+public:
+  struct Record
+  {
+    std::string_view filePath;
+    std::string_view newFilePath;
+    std::string_view artist;
+    std::string_view title;
+    bool result = false;
+    bool detected = false;
+    double score = 0.0;
+    const char* fpCache = nullptr;
+    const char* lookupCache = nullptr;
+    const std::vector<double>* stageSec = nullptr;
+    double totalSec = 0.0;
+  };
+
+public:
+  Reporter(const std::string& p_Format, bool p_Json, const std::vector<std::string>& p_StageNames);
+  ~Reporter();
+  void Write(const Record& p_Record);
+  void Flush();
+  void Format(const Record& p_Record, std::string& p_Out) const;
+
+private:
+  enum Field
+  {
+    Text,
+    InputPath,
+    OutputPath,
+    Result,
+    Artist,
+    Title,
+    Score,
+    FpCache,
+    LookupCache,
+    StageTimes,
+    TotalTime,
+  };
+
+  struct Token
+  {
+    Field field = Text;
+    std::string text;
+  };
+
+  void FormatText(const Record& p_Record, std::string& p_Out) const;
+  void FormatJson(const Record& p_Record, std::string& p_Out) const;
+  void AppendStageTimes(const Record& p_Record, const char* p_Quote, const char* p_Separator,
+                        std::string& p_Out) const;
+  static void AppendJsonString(std::string_view p_Str, std::string& p_Out);
+  static void AppendNumber(double p_Value, std::string& p_Out);
+
+private:
+  bool m_Json = false;
+  bool m_Immediate = false;
+  std::vector<Token> m_Tokens;
+  std::vector<std::string> m_StageNames;
+  std::string m_Buffer;
+  std::chrono::steady_clock::time_point m_FlushTime;
+};
@@ -0,0 +1,344 @@
+// scanner.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "scanner.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+#include "log.h"
+#include "stats.h"
+#include "util.h"
+
+// Max directories listed ahead of the emitter
+static const size_t s_MaxPrefetched = 1024;
+
+Scanner::Scanner(int p_Threads, const std::set<std::string>& p_Extensions,
+                 const Filter& p_Filter)
+  : m_Threads(std::max(p_Threads, 1))
+  , m_Extensions(p_Extensions)
+  , m_Filter(p_Filter)
+{
+}
+
+void Scanner::Scan(const std::vector<std::string>& p_Paths, const Callback& p_Callback)
+{
+  // Resolve roots once, entries below them are built by appending names
+  std::vector<Entry> roots;
+  for (const auto& path : p_Paths)
+  {
+    std::error_code ec;
+    Entry root;
+    root.name = std::filesystem::canonical(path, ec).string();
+    struct stat st;
+    if (ec || (stat(root.name.c_str(), &st) != 0))
+    {
+      Log::Debug("scan failed for %s", path.c_str());
+      continue;
+    }
+
+    root.dev = st.st_dev;
+    root.ino = st.st_ino;
+    if (S_ISDIR(st.st_mode))
+    {
+      root.dir = std::make_shared<Dir>();
+      root.dir->path = root.name;
+      root.dir->dev = st.st_dev;
+      root.dir->ino = st.st_ino;
+      m_Pending.push_back(root.dir);
+    }
+    else if (!S_ISREG(st.st_mode))
+    {
+      continue;
+    }
+
+    roots.push_back(std::move(root));
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < m_Threads; ++i)
+  {
+    threads.emplace_back(&Scanner::Process, this);
+  }
+
+  for (auto& root : roots)
+  {
+    if (root.dir)
+    {
+      Emit(root.dir, p_Callback);
+      root.dir.reset();
+    }
+    else if (Claim(root.dev, root.ino))
+    {
+      p_Callback(root.name);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Done = true;
+    m_Cond.notify_all();
+  }
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+}
+
+void Scanner::Process()
+{
+  while (true)
+  {
+    std::shared_ptr<Dir> dir;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Cond.wait(lock, [&]()
+      {
+        return m_Done || (!m_Pending.empty() && (m_Prefetched < s_MaxPrefetched));
+      });
+      if (m_Done)
+      {
+        return;
+      }
+
+      dir = m_Pending.front();
+      m_Pending.pop_front();
+      if (dir->claimed)
+      {
+        continue;
+      }
+
+      dir->claimed = true;
+      ++m_Prefetched;
+    }
+
+    List(dir);
+  }
+}
+
+void Scanner::Emit(const std::shared_ptr<Dir>& p_Root, const Callback& p_Callback)
+{
+  std::vector<std::pair<std::shared_ptr<Dir>, size_t>> stack;
+  if (!Claim(p_Root->dev, p_Root->ino))
+  {
+    Discard(p_Root);
+    return;
+  }
+
+  WaitListed(p_Root);
+  stack.emplace_back(p_Root, 0);
+  while (!stack.empty())
+  {
+    std::shared_ptr<Dir> dir = stack.back().first;
+    size_t& index = stack.back().second;
+    if (index >= dir->entries.size())
+    {
+      // Release the listing, only the path to the current directory is kept in memory
+      std::vector<Entry>().swap(dir->entries);
+      stack.pop_back();
+      continue;
+    }
+
+    const Entry& entry = dir->entries[index++];
+    if (!Claim(entry.dev, entry.ino))
+    {
+      if (entry.dir)
+      {
+        Discard(entry.dir);
+      }
+
+      continue;
+    }
+
+    if (entry.dir)
+    {
+      WaitListed(entry.dir);
+      stack.emplace_back(entry.dir, 0);
+    }
+    else
+    {
+      p_Callback(entry.target.empty() ? MakePath(dir->path, entry.name) : entry.target);
+    }
+  }
+}
+
+void Scanner::WaitListed(const std::shared_ptr<Dir>& p_Dir)
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  if (!p_Dir->claimed)
+  {
+    // Not picked up by a worker yet, list it here rather than wait
+    p_Dir->claimed = true;
+    ++m_Prefetched;
+    lock.unlock();
+    List(p_Dir);
+    lock.lock();
+  }
+
+  m_Cond.wait(lock, [&]() { return p_Dir->listed; });
+  --m_Prefetched;
+  m_Cond.notify_all();
+}
+
+void Scanner::Discard(const std::shared_ptr<Dir>& p_Dir)
+{
+  std::vector<std::shared_ptr<Dir>> subdirs;
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if (!p_Dir->claimed)
+    {
+      // Keep workers from listing it
+      p_Dir->claimed = true;
+      return;
+    }
+
+    // Already prefetched, release it and whatever it queued
+    m_Cond.wait(lock, [&]() { return p_Dir->listed; });
+    --m_Prefetched;
+    m_Cond.notify_all();
+    for (const auto& entry : p_Dir->entries)
+    {
+      if (entry.dir)
+      {
+        subdirs.push_back(entry.dir);
+      }
+    }
+
+    std::vector<Entry>().swap(p_Dir->entries);
+  }
+
+  for (const auto& subdir : subdirs)
+  {
+    Discard(subdir);
+  }
+}
+
+void Scanner::List(const std::shared_ptr<Dir>& p_Dir)
+{
+  Stats::Timer timer("scan.listdir");
+  std::vector<Entry> entries;
+  DIR* dirp = opendir(p_Dir->path.c_str());
+  if (dirp == nullptr)
+  {
+    Log::Debug("opendir failed for %s", p_Dir->path.c_str());
+  }
+  else
+  {
+    const int fd = dirfd(dirp);
+    struct dirent* dent = nullptr;
+    while ((dent = readdir(dirp)) != nullptr)
+    {
+      const std::string name = dent->d_name;
+      if ((name == ".") || (name == ".."))
+      {
+        continue;
+      }
+
+      Entry entry;
+      entry.name = name;
+      entry.dev = p_Dir->dev;
+      entry.ino = dent->d_ino;
+
+      // Regular files are taken from the listing as is, only other types need a stat
+      struct stat st;
+      unsigned char type = dent->d_type;
+      const bool allowed =
+        m_Extensions.find(Util::ToLower(Util::GetFileExt(name))) != m_Extensions.end();
+      if (!allowed && (type != DT_DIR) && (type != DT_UNKNOWN))
+      {
+        continue;
+      }
+
+      if ((type == DT_LNK) || (type == DT_UNKNOWN) || (type == DT_DIR))
+      {
+        // Symlinks are followed for files but not for directories, as before
+        if (fstatat(fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+          continue;
+        }
+
+        const bool isLink = S_ISLNK(st.st_mode);
+        if (isLink && ((fstatat(fd, name.c_str(), &st, 0) != 0) || S_ISDIR(st.st_mode)))
+        {
+          continue;
+        }
+
+        type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+        entry.dev = st.st_dev;
+        entry.ino = st.st_ino;
+        if (isLink && (type == DT_REG))
+        {
+          // Reported by target path, so that renames and tag edits apply to the target
+          std::error_code ec;
+          entry.target =
+            std::filesystem::canonical(MakePath(p_Dir->path, name), ec).string();
+          if (ec)
+          {
+            continue;
+          }
+        }
+      }
+
+      if (type == DT_DIR)
+      {
+        entry.dir = std::make_shared<Dir>();
+        entry.dir->path = MakePath(p_Dir->path, name);
+        entry.dir->dev = entry.dev;
+        entry.dir->ino = entry.ino;
+      }
+      else if ((type != DT_REG) || !allowed)
+      {
+        continue;
+      }
+      else if (m_Filter && !m_Filter(fd, name))
+      {
+        Log::Debug("scan skipped %s", MakePath(p_Dir->path, name).c_str());
+        Stats::AddCount("scan.skipped");
+        continue;
+      }
+
+      entries.push_back(std::move(entry));
+    }
+
+    closedir(dirp);
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& p_Lhs, const Entry& p_Rhs) { return p_Lhs.name < p_Rhs.name; });
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  p_Dir->entries = std::move(entries);
+  p_Dir->listed = true;
+
+  // Queue subdirectories first in line so prefetching runs ahead in emit order
+  for (auto it = p_Dir->entries.rbegin(); it != p_Dir->entries.rend(); ++it)
+  {
+    if (it->dir)
+    {
+      m_Pending.push_front(it->dir);
+    }
+  }
+
+  m_Cond.notify_all();
+}
+
+bool Scanner::Claim(dev_t p_Dev, ino_t p_Ino)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Seen.insert(std::make_pair(p_Dev, p_Ino)).second;
+}
+
+std::string Scanner::MakePath(const std::string& p_DirPath, const std::string& p_Name)
+{
+  return p_DirPath + ((p_DirPath == "/") ? "" : "/") + p_Name;
+}
@@ -0,0 +1,77 @@
+// scanner.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Walks directory trees with several threads listing directories ahead of a single
+// emitter, which reports files in sorted depth-first order as soon as they are known.
+// Files reached more than once (hardlinks, symlinks, bind mounts) are reported once, and
+// symlinked files by the path of their target.
+// Files found in directories are filtered by extension and an optional content check,
+// while files given as paths are always reported.
+class Scanner
+{
+public:
+  typedef std::function<void(const std::string&)> Callback;
+  typedef std::function<bool(int p_DirFd, const std::string& p_Name)> Filter;
+
+  Scanner(int p_Threads, const std::set<std::string>& p_Extensions, const Filter& p_Filter);
+  void Scan(const std::vector<std::string>& p_Paths, const Callback& p_Callback);
+
+private:
+  struct Dir;
+
+  struct Entry
+  {
+    std::string name;
+    std::string target;
+    dev_t dev = 0;
+    ino_t ino = 0;
+    std::shared_ptr<Dir> dir;
+  };
+
+  struct Dir
+  {
+    std::string path;
+    dev_t dev = 0;
+    ino_t ino = 0;
+    bool claimed = false;
+    bool listed = false;
+    std::vector<Entry> entries;
+  };
+
+  void Process();
+  void Emit(const std::shared_ptr<Dir>& p_Dir, const Callback& p_Callback);
+  void WaitListed(const std::shared_ptr<Dir>& p_Dir);
+  void Discard(const std::shared_ptr<Dir>& p_Dir);
+  void List(const std::shared_ptr<Dir>& p_Dir);
+  bool Claim(dev_t p_Dev, ino_t p_Ino);
+  static std::string MakePath(const std::string& p_DirPath, const std::string& p_Name);
+
+private:
+  int m_Threads = 1;
+  std::set<std::string> m_Extensions;
+  Filter m_Filter;
+  size_t m_Prefetched = 0;
+  bool m_Done = false;
+  std::deque<std::shared_ptr<Dir>> m_Pending;
+  std::set<std::pair<dev_t, ino_t>> m_Seen;
+  std::mutex m_Mutex;
+  std::condition_variable m_Cond;
+};
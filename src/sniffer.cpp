@@ -0,0 +1,181 @@
+// sniffer.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "sniffer.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+// Bytes searched for the first frame after any ID3v2 tag
+static const size_t s_SearchSize = 4096;
+
+// Bitrates in kbit/s by [MPEG-1 ? 0 : 1][layer - 1][index]
+static const int s_Bitrates[2][3][16] =
+{
+  {
+    { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+  },
+  {
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+  },
+};
+
+static const int s_SampleRates[3] = { 44100, 48000, 32000 };
+
+bool Sniffer::Check(int p_DirFd, const std::string& p_Name, int p_MinDurationSec)
+{
+  const int fd = openat(p_DirFd, p_Name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+  {
+    return false;
+  }
+
+  double durationSec = 0;
+  const bool result = GetDuration(fd, durationSec) && (durationSec >= p_MinDurationSec);
+  close(fd);
+
+  return result;
+}
+
+bool Sniffer::GetDuration(int p_Fd, double& p_DurationSec)
+{
+  struct stat st;
+  if (fstat(p_Fd, &st) != 0)
+  {
+    return false;
+  }
+
+  // Skip ID3v2 tag, its size is stored as a 28-bit syncsafe integer
+  std::vector<uint8_t> buf(10);
+  off_t offset = 0;
+  if ((pread(p_Fd, buf.data(), buf.size(), 0) == 10) && (memcmp(buf.data(), "ID3", 3) == 0))
+  {
+    offset = 10 + ((buf[6] & 0x7F) << 21) + ((buf[7] & 0x7F) << 14) + ((buf[8] & 0x7F) << 7) +
+      (buf[9] & 0x7F) + ((buf[5] & 0x10) ? 10 : 0);
+  }
+
+  buf.resize(s_SearchSize);
+  const ssize_t len = pread(p_Fd, buf.data(), buf.size(), offset);
+  if (len < 4)
+  {
+    return false;
+  }
+
+  // Find a frame followed by another frame header, to not be fooled by stray sync bits
+  FrameHeader header;
+  ssize_t pos = 0;
+  for ( ; (pos + 4) <= len; ++pos)
+  {
+    FrameHeader next;
+    if (ParseFrameHeader(&buf[pos], header) &&
+        (((pos + header.frameLength + 4) > len) ||
+         ParseFrameHeader(&buf[pos + header.frameLength], next)))
+    {
+      break;
+    }
+  }
+
+  if ((pos + 4) > len)
+  {
+    return false;
+  }
+
+  // VBR files carry the frame count in a Xing / Info or VBRI header in the first frame,
+  // optionally with the byte count
+  uint32_t frames = 0;
+  uint32_t bytes = 0;
+  const ssize_t xingPos = pos + 4 + ((header.version == 1) ? (header.mono ? 17 : 32)
+                                                           : (header.mono ? 9 : 17));
+  const ssize_t vbriPos = pos + 4 + 32;
+  if (((xingPos + 12) <= len) &&
+      ((memcmp(&buf[xingPos], "Xing", 4) == 0) || (memcmp(&buf[xingPos], "Info", 4) == 0)) &&
+      (ReadBE32(&buf[xingPos + 4]) & 0x1))
+  {
+    frames = ReadBE32(&buf[xingPos + 8]);
+    if (((xingPos + 16) <= len) && (ReadBE32(&buf[xingPos + 4]) & 0x2))
+    {
+      bytes = ReadBE32(&buf[xingPos + 12]);
+    }
+  }
+  else if (((vbriPos + 18) <= len) && (memcmp(&buf[vbriPos], "VBRI", 4) == 0))
+  {
+    frames = ReadBE32(&buf[vbriPos + 14]);
+    bytes = ReadBE32(&buf[vbriPos + 10]);
+  }
+
+  const off_t audioSize = st.st_size - offset - pos;
+  if (frames > 0)
+  {
+    p_DurationSec = static_cast<double>(frames) * header.samplesPerFrame / header.sampleRate;
+
+    // Truncated files only hold the share of the frames their size allows for
+    if ((bytes > 0) && (audioSize < static_cast<off_t>(bytes)))
+    {
+      p_DurationSec = p_DurationSec * static_cast<double>(audioSize) / bytes;
+    }
+  }
+  else
+  {
+    // Assume constant bitrate
+    p_DurationSec = static_cast<double>(audioSize) * 8 / (header.bitrate * 1000);
+  }
+
+  return true;
+}
+
+bool Sniffer::ParseFrameHeader(const uint8_t* p_Data, FrameHeader& p_Header)
+{
+  if ((p_Data[0] != 0xFF) || ((p_Data[1] & 0xE0) != 0xE0))
+  {
+    return false;
+  }
+
+  const int versionBits = (p_Data[1] >> 3) & 0x3;
+  const int layerBits = (p_Data[1] >> 1) & 0x3;
+  const int bitrateIndex = (p_Data[2] >> 4) & 0xF;
+  const int sampleRateIndex = (p_Data[2] >> 2) & 0x3;
+  if ((versionBits == 1) || (layerBits == 0) || (bitrateIndex == 0) || (bitrateIndex == 15) ||
+      (sampleRateIndex == 3))
+  {
+    return false;
+  }
+
+  p_Header.version = (versionBits == 3) ? 1 : ((versionBits == 2) ? 2 : 3);
+  p_Header.layer = 4 - layerBits;
+  p_Header.bitrate = s_Bitrates[(p_Header.version == 1) ? 0 : 1][p_Header.layer - 1][bitrateIndex];
+  p_Header.sampleRate = s_SampleRates[sampleRateIndex] >> (p_Header.version - 1);
+  p_Header.mono = ((p_Data[3] >> 6) & 0x3) == 3;
+
+  const int padding = (p_Data[2] >> 1) & 0x1;
+  if (p_Header.layer == 1)
+  {
+    p_Header.samplesPerFrame = 384;
+    p_Header.frameLength = (12 * p_Header.bitrate * 1000 / p_Header.sampleRate + padding) * 4;
+  }
+  else
+  {
+    p_Header.samplesPerFrame = ((p_Header.layer == 3) && (p_Header.version != 1)) ? 576 : 1152;
+    p_Header.frameLength =
+      (p_Header.samplesPerFrame / 8) * p_Header.bitrate * 1000 / p_Header.sampleRate + padding;
+  }
+
+  return true;
+}
+
+uint32_t Sniffer::ReadBE32(const uint8_t* p_Data)
+{
+  return (static_cast<uint32_t>(p_Data[0]) << 24) | (static_cast<uint32_t>(p_Data[1]) << 16) |
+    (static_cast<uint32_t>(p_Data[2]) << 8) | static_cast<uint32_t>(p_Data[3]);
+}
@@ -0,0 +1,34 @@
+// sniffer.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Cheap MP3 content check from the first few KB of a file, without decoding audio.
+class Sniffer
+{
+public:
+  static bool Check(int p_DirFd, const std::string& p_Name, int p_MinDurationSec);
+  static bool GetDuration(int p_Fd, double& p_DurationSec);
+
+private:
+  struct FrameHeader
+  {
+    int version = 0; // 1 = MPEG-1, 2 = MPEG-2, 3 = MPEG-2.5
+    int layer = 0;
+    int bitrate = 0; // kbit/s
+    int sampleRate = 0;
+    int samplesPerFrame = 0;
+    int frameLength = 0;
+    bool mono = false;
+  };
+
+  static bool ParseFrameHeader(const uint8_t* p_Data, FrameHeader& p_Header);
+  static uint32_t ReadBE32(const uint8_t* p_Data);
+};
@@ -0,0 +1,208 @@
+// statedb.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "statedb.h"
+
+#include <cstring>
+#include <ctime>
+#include <functional>
+
+#include "log.h"
+
+static const char s_Magic[8] = { 'I', 'D', 'N', 'T', 'S', 'D', 'B', '1' };
+
+// On-disk record, records written before operations were stored have them zero and are
+// thus never unchanged
+struct Record
+{
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtimeNs;
+  int64_t time;
+  uint32_t result;
+  uint32_t operations;
+};
+
+std::mutex StateDb::m_Mutex;
+std::string StateDb::m_Path;
+RecordLog StateDb::m_Log("state db", s_Magic);
+std::unordered_map<StateDb::Key, StateDb::Entry, StateDb::KeyHash> StateDb::m_Entries;
+
+bool StateDb::Key::operator==(const Key& p_Other) const
+{
+  return (dev == p_Other.dev) && (ino == p_Other.ino);
+}
+
+size_t StateDb::KeyHash::operator()(const Key& p_Key) const
+{
+  size_t hash = std::hash<uint64_t>()(p_Key.ino);
+  hash ^= std::hash<uint64_t>()(p_Key.dev) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+void StateDb::Init(const std::string& p_Path)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Path = p_Path;
+  if (!Load())
+  {
+    Log::Debug("state db disabled");
+    m_Entries.clear();
+    return;
+  }
+
+  const auto writer = []()
+  {
+    for (const auto& entry : m_Entries)
+    {
+      if (!Append(entry.first, entry.second))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  };
+
+  if (m_Log.NeedsCompact(m_Entries.size()) && m_Log.Compact(writer))
+  {
+    m_Entries.clear();
+    if (!Load())
+    {
+      m_Entries.clear();
+    }
+  }
+}
+
+void StateDb::Cleanup()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Log.Close();
+  m_Entries.clear();
+}
+
+bool StateDb::IsUnchanged(const struct stat& p_Stat, uint32_t p_Operations)
+{
+  Key key;
+  key.dev = static_cast<uint64_t>(p_Stat.st_dev);
+  key.ino = static_cast<uint64_t>(p_Stat.st_ino);
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto it = m_Entries.find(key);
+  return (it != m_Entries.end()) && it->second.result &&
+         (it->second.operations == p_Operations) &&
+         (it->second.size == static_cast<uint64_t>(p_Stat.st_size)) &&
+         (it->second.mtimeNs == GetMtimeNs(p_Stat));
+}
+
+void StateDb::Set(const std::string& p_FilePath, bool p_Result, uint32_t p_Operations)
+{
+  struct stat st;
+  if (stat(p_FilePath.c_str(), &st) != 0)
+  {
+    return;
+  }
+
+  Key key;
+  key.dev = static_cast<uint64_t>(st.st_dev);
+  key.ino = static_cast<uint64_t>(st.st_ino);
+
+  Entry entry;
+  entry.size = static_cast<uint64_t>(st.st_size);
+  entry.mtimeNs = GetMtimeNs(st);
+  entry.time = static_cast<int64_t>(time(nullptr));
+  entry.result = p_Result;
+  entry.operations = p_Operations;
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (!m_Log.IsOpen() || !Append(key, entry))
+  {
+    return;
+  }
+
+  auto it = m_Entries.find(key);
+  if (it != m_Entries.end())
+  {
+    it->second = entry;
+    m_Log.AddSuperseded();
+  }
+  else
+  {
+    m_Entries.emplace(key, entry);
+  }
+}
+
+int64_t StateDb::GetMtimeNs(const struct stat& p_Stat)
+{
+#ifdef __APPLE__
+  return (static_cast<int64_t>(p_Stat.st_mtimespec.tv_sec) * 1000000000) +
+         p_Stat.st_mtimespec.tv_nsec;
+#else
+  return (static_cast<int64_t>(p_Stat.st_mtim.tv_sec) * 1000000000) + p_Stat.st_mtim.tv_nsec;
+#endif
+}
+
+bool StateDb::Load()
+{
+  if (!m_Log.Open(m_Path, false /*p_Truncate*/, ReadRecord))
+  {
+    return false;
+  }
+
+  Log::Debug("state db loaded %zu entries", m_Entries.size());
+  return true;
+}
+
+size_t StateDb::ReadRecord(const char* p_Data, size_t p_Size, size_t p_Offset)
+{
+  (void)p_Offset;
+  if (p_Size < sizeof(Record))
+  {
+    return 0;
+  }
+
+  Record record;
+  memcpy(&record, p_Data, sizeof(Record));
+
+  Key key;
+  key.dev = record.dev;
+  key.ino = record.ino;
+
+  Entry entry;
+  entry.size = record.size;
+  entry.mtimeNs = record.mtimeNs;
+  entry.time = record.time;
+  entry.result = (record.result != 0);
+  entry.operations = record.operations;
+
+  auto it = m_Entries.find(key);
+  if (it != m_Entries.end())
+  {
+    it->second = entry;
+    m_Log.AddSuperseded();
+  }
+  else
+  {
+    m_Entries.emplace(key, entry);
+  }
+
+  return sizeof(Record);
+}
+
+bool StateDb::Append(const Key& p_Key, const Entry& p_Entry)
+{
+  Record record;
+  record.dev = p_Key.dev;
+  record.ino = p_Key.ino;
+  record.size = p_Entry.size;
+  record.mtimeNs = p_Entry.mtimeNs;
+  record.time = p_Entry.time;
+  record.result = p_Entry.result ? 1 : 0;
+  record.operations = p_Entry.operations;
+  return m_Log.Append(&record, sizeof(Record));
+}
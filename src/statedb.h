@@ -0,0 +1,63 @@
+// statedb.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#include "recordlog.h"
+
+// Persistent state of processed files keyed by device and inode, which renames and in-place
+// tag updates keep, so that incremental runs can skip files unchanged since they passed the
+// same operations. The state file is an append-only log of fixed-size records.
+class StateDb
+{
+public:
+  static void Init(const std::string& p_Path);
+  static void Cleanup();
+  static bool IsUnchanged(const struct stat& p_Stat, uint32_t p_Operations);
+  static void Set(const std::string& p_FilePath, bool p_Result, uint32_t p_Operations);
+  static int64_t GetMtimeNs(const struct stat& p_Stat);
+
+private:
+  struct Key
+  {
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+
+    bool operator==(const Key& p_Other) const;
+  };
+
+  struct KeyHash
+  {
+    size_t operator()(const Key& p_Key) const;
+  };
+
+  struct Entry
+  {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    int64_t time = 0;
+    bool result = false;
+    uint32_t operations = 0;
+  };
+
+  static bool Load();
+  static size_t ReadRecord(const char* p_Data, size_t p_Size, size_t p_Offset);
+  static bool Append(const Key& p_Key, const Entry& p_Entry);
+
+private:
+  static std::mutex m_Mutex;
+  static std::string m_Path;
+  static RecordLog m_Log;
+  static std::unordered_map<Key, Entry, KeyHash> m_Entries;
+};
@@ -0,0 +1,183 @@
+// stats.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+#include <nlohmann/json.hpp>
+
+static const int s_SubBuckets = 8;
+
+bool Stats::m_Enabled = false;
+std::map<std::string, int64_t> Stats::m_Counters;
+std::map<std::string, Stats::Histogram> Stats::m_Histograms;
+std::mutex Stats::m_Mutex;
+
+Stats::Timer::Timer(const char* p_Name)
+{
+  if (m_Enabled)
+  {
+    m_Name = p_Name;
+    m_Start = std::chrono::steady_clock::now();
+  }
+}
+
+Stats::Timer::~Timer()
+{
+  if (m_Name != nullptr)
+  {
+    AddTime(m_Name,
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count());
+  }
+}
+
+void Stats::SetEnabled(bool p_Enabled)
+{
+  m_Enabled = p_Enabled;
+}
+
+bool Stats::IsEnabled()
+{
+  return m_Enabled;
+}
+
+void Stats::AddCount(const std::string& p_Name, int64_t p_Count)
+{
+  if (!m_Enabled) return;
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Counters[p_Name] += p_Count;
+}
+
+void Stats::AddTime(const std::string& p_Name, double p_Sec)
+{
+  if (!m_Enabled) return;
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  AddToHistogram(m_Histograms[p_Name], p_Sec);
+}
+
+void Stats::Print(bool p_Json)
+{
+  if (!m_Enabled) return;
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  static const double percentiles[] = { 0.50, 0.90, 0.99 };
+  if (p_Json)
+  {
+    nlohmann::json jsonDoc;
+    jsonDoc["counters"] = nlohmann::json::object();
+    for (const auto& counter : m_Counters)
+    {
+      jsonDoc["counters"][counter.first] = counter.second;
+    }
+
+    jsonDoc["timers"] = nlohmann::json::object();
+    for (const auto& histogram : m_Histograms)
+    {
+      nlohmann::json& jsonTimer = jsonDoc["timers"][histogram.first];
+      jsonTimer["count"] = histogram.second.count;
+      jsonTimer["total_sec"] = histogram.second.sumSec;
+      jsonTimer["p50_ms"] = GetPercentile(histogram.second, percentiles[0]) * 1000;
+      jsonTimer["p90_ms"] = GetPercentile(histogram.second, percentiles[1]) * 1000;
+      jsonTimer["p99_ms"] = GetPercentile(histogram.second, percentiles[2]) * 1000;
+      jsonTimer["max_ms"] = histogram.second.maxSec * 1000;
+    }
+
+    std::cerr << jsonDoc.dump() << "\n";
+    return;
+  }
+
+  char line[256];
+  snprintf(line, sizeof(line), "%-28s %8s %10s %10s %10s %10s %10s\n",
+           "timer", "count", "total_s", "p50_ms", "p90_ms", "p99_ms", "max_ms");
+  std::cerr << line;
+  for (const auto& histogram : m_Histograms)
+  {
+    const Histogram& h = histogram.second;
+    snprintf(line, sizeof(line), "%-28s %8lld %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+             histogram.first.c_str(), static_cast<long long>(h.count), h.sumSec,
+             GetPercentile(h, percentiles[0]) * 1000, GetPercentile(h, percentiles[1]) * 1000,
+             GetPercentile(h, percentiles[2]) * 1000, h.maxSec * 1000);
+    std::cerr << line;
+  }
+
+  std::cerr << "\n";
+  snprintf(line, sizeof(line), "%-28s %8s\n", "counter", "count");
+  std::cerr << line;
+  for (const auto& counter : m_Counters)
+  {
+    snprintf(line, sizeof(line), "%-28s %8lld\n", counter.first.c_str(),
+             static_cast<long long>(counter.second));
+    std::cerr << line;
+  }
+}
+
+void Stats::AddToHistogram(Histogram& p_Histogram, double p_Sec)
+{
+  p_Histogram.minSec = (p_Histogram.count == 0) ? p_Sec : std::min(p_Histogram.minSec, p_Sec);
+  p_Histogram.maxSec = std::max(p_Histogram.maxSec, p_Sec);
+  p_Histogram.sumSec += p_Sec;
+  ++p_Histogram.count;
+
+  const size_t bucket = GetBucket(p_Sec);
+  if (bucket >= p_Histogram.buckets.size())
+  {
+    p_Histogram.buckets.resize(bucket + 1);
+  }
+
+  ++p_Histogram.buckets[bucket];
+}
+
+double Stats::GetPercentile(const Histogram& p_Histogram, double p_Percentile)
+{
+  const int64_t rank = static_cast<int64_t>(std::ceil(p_Percentile * p_Histogram.count));
+  int64_t seen = 0;
+  for (size_t bucket = 0; bucket < p_Histogram.buckets.size(); ++bucket)
+  {
+    seen += p_Histogram.buckets[bucket];
+    if (seen >= rank)
+    {
+      return std::min(std::max(GetBucketValue(bucket), p_Histogram.minSec), p_Histogram.maxSec);
+    }
+  }
+
+  return p_Histogram.maxSec;
+}
+
+size_t Stats::GetBucket(double p_Sec)
+{
+  // Values below 1 us share the first bucket
+  const double us = p_Sec * 1e6;
+  if (us < 1.0)
+  {
+    return 0;
+  }
+
+  int exp = 0;
+  const double frac = std::frexp(us, &exp); // us = frac * 2^exp, frac in [0.5, 1)
+  const int sub = static_cast<int>((frac - 0.5) * 2 * s_SubBuckets);
+  return 1 + static_cast<size_t>((exp - 1) * s_SubBuckets + sub);
+}
+
+double Stats::GetBucketValue(size_t p_Bucket)
+{
+  // Midpoint of the bucket range
+  if (p_Bucket == 0)
+  {
+    return 0.5e-6;
+  }
+
+  const int exp = static_cast<int>((p_Bucket - 1) / s_SubBuckets) + 1;
+  const int sub = static_cast<int>((p_Bucket - 1) % s_SubBuckets);
+  const double frac = 0.5 + (sub + 0.5) / (2 * s_SubBuckets);
+  return std::ldexp(frac, exp) * 1e-6;
+}
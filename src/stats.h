@@ -0,0 +1,61 @@
+// stats.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Run statistics: named counters and latency histograms, printed at exit with --stats.
+class Stats
+{
+public:
+  // Records the time from construction to destruction under the given name
+  class Timer
+  {
+  public:
+    explicit Timer(const char* p_Name);
+    ~Timer();
+
+  private:
+    const char* m_Name = nullptr;
+    std::chrono::steady_clock::time_point m_Start;
+  };
+
+public:
+  static void SetEnabled(bool p_Enabled);
+  static bool IsEnabled();
+  static void AddCount(const std::string& p_Name, int64_t p_Count = 1);
+  static void AddTime(const std::string& p_Name, double p_Sec);
+  static void Print(bool p_Json);
+
+private:
+  // Log-linear buckets of microseconds, 8 per power of two, i.e. within 12.5% of the value
+  struct Histogram
+  {
+    int64_t count = 0;
+    double sumSec = 0;
+    double minSec = 0;
+    double maxSec = 0;
+    std::vector<int64_t> buckets;
+  };
+
+  static void AddToHistogram(Histogram& p_Histogram, double p_Sec);
+  static double GetPercentile(const Histogram& p_Histogram, double p_Percentile);
+  static size_t GetBucket(double p_Sec);
+  static double GetBucketValue(size_t p_Bucket);
+
+private:
+  static bool m_Enabled;
+  static std::map<std::string, int64_t> m_Counters;
+  static std::map<std::string, Histogram> m_Histograms;
+  static std::mutex m_Mutex;
+};
@@ -7,14 +7,11 @@
 
 #include "tag.h"
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
-#include <regex>
 
-#include <taglib/id3v2tag.h>
-#include <taglib/mpegfile.h>
-#include <taglib/tag.h>
-
-#include "log.h"
+#include "nameindex.h"
 
 std::string Tag::MakePath(const std::string& p_FilePath, std::string& p_Artist,
                           std::string& p_Title)
@@ -34,229 +31,140 @@ std::string Tag::MakePath(const std::string& p_FilePath, std::string& p_Artist,
     title = "Unknown";
   }
 
-  const std::string baseName = artist + "-" + title;
-  const std::string extension = ".mp3";
-
-  // Start with the base filename
-  std::filesystem::path outputPath = directory / (baseName + extension);
-
-  // If it exists, append _1, _2, _3 ...
-  int counter = 1;
-  while (std::filesystem::exists(outputPath))
-  {
-    const std::string numbered = baseName + "_" + std::to_string(counter) + extension;
-    outputPath = directory / numbered;
-    ++counter;
-  }
-
-  return outputPath.string();
+  // Reserves a free name, appending _1, _2, _3 ... if taken
+  return NameIndex::Reserve(directory.string(), artist + "-" + title, ".mp3");
 }
 
-bool Tag::Read(const std::string& p_FilePath, std::string& p_Artist, std::string& p_Title)
+std::string Tag::SanitizeFileName(const std::string& p_FileName)
 {
-  TagLib::MPEG::File file(p_FilePath.c_str());
-  if (!file.isValid())
+  // Single pass over UTF-8 that strips control chars and path separators, turns runs of
+  // spaces and underscores into one underscore, and drops them at start and end
+  const char* data = p_FileName.data();
+  const size_t size = p_FileName.size();
+  std::string out;
+  out.reserve(size);
+  bool separator = false;
+  size_t i = 0;
+  while (i < size)
   {
-    return false;
-  }
+    // ASCII fast path, copies eight bytes at a time while none of them needs handling
+    uint64_t word = 0;
+    if ((i + sizeof(word)) <= size)
+    {
+      memcpy(&word, data + i, sizeof(word));
+      if (IsPlain(word))
+      {
+        if (separator && !out.empty())
+        {
+          out.push_back('_');
+        }
+
+        separator = false;
+        out.append(data + i, sizeof(word));
+        i += sizeof(word);
+        continue;
+      }
+    }
 
-  // Prefer ID3v2 tag; if not present, fall back to generic tag (e.g. ID3v1)
-  TagLib::Tag* tag = file.ID3v2Tag(false);
-  if (!tag)
-  {
-    tag = file.tag();
-  }
+    char32_t c = 0;
+    const size_t len = DecodeUtf8(data + i, size - i, c);
+    i += std::max<size_t>(len, 1);
 
-  if (!tag)
-  {
-    return false;
-  }
+    // Strip malformed bytes, control chars and path separators
+    if ((len == 0) || (c < 0x20) || (c == U'/') || (c == U'\\') || (c == 0x7F))
+    {
+      continue;
+    }
 
-  const TagLib::String artistStr = tag->artist();
-  const TagLib::String titleStr = tag->title();
+    if ((c == U' ') || (c == U'_'))
+    {
+      separator = true;
+      continue;
+    }
 
-  // true => return UTF-8 in Unicode-aware builds
-  p_Artist = artistStr.to8Bit(true);
-  p_Title = titleStr.to8Bit(true);
+    if (separator && !out.empty())
+    {
+      out.push_back('_');
+    }
 
-  if (p_Artist.empty() || p_Title.empty())
+    // On POSIX (Linux/macOS) we can safely keep all other Unicode codepoints.
+    // This preserves CJK, accents, etc. directly in the filename.
+    separator = false;
+    AppendUtf8(c, out);
+  }
+
+  if (out.empty())
   {
-    return false;
+    out = "unnamed";
   }
 
-  return true;
+  return out;
 }
 
-bool Tag::Write(const std::string& p_FilePath, const std::string& p_Artist,
-                const std::string& p_Title)
+bool Tag::IsPlain(uint64_t p_Word)
 {
-  TagLib::MPEG::File file(p_FilePath.c_str());
-  if (!file.isValid())
-  {
-    return false;
-  }
+  // SWAR checks for any byte that is non-ASCII, below 0x21 (control chars and space),
+  // or one of / \\ _ DEL
+  static const uint64_t ones = 0x0101010101010101ULL;
+  static const uint64_t highs = 0x8080808080808080ULL;
+  auto hasZero = [](uint64_t p_Value) { return ((p_Value - ones) & ~p_Value & highs) != 0; };
+  auto hasByte = [&](uint8_t p_Byte) { return hasZero(p_Word ^ (ones * p_Byte)); };
+
+  return ((p_Word & highs) == 0) && (((p_Word - (ones * 0x21)) & ~p_Word & highs) == 0) &&
+         !hasByte('/') && !hasByte('\\') && !hasByte('_') && !hasByte(0x7F);
+}
 
-  TagLib::Tag* tag = file.ID3v2Tag(true);
-  if (!tag)
+size_t Tag::DecodeUtf8(const char* p_Data, size_t p_Size, char32_t& p_Char)
+{
+  // Lenient decoding, continuation bytes are not validated and overlong forms are accepted
+  const unsigned char c = p_Data[0];
+  if (c < 0x80)
   {
-    return false;
+    p_Char = c;
+    return 1;
   }
-
-  tag->setArtist(TagLib::String(p_Artist, TagLib::String::UTF8));
-  tag->setTitle(TagLib::String(p_Title, TagLib::String::UTF8));
-
-  if (!file.save())
+  else if (((c >> 5) == 0x6) && (p_Size > 1))
   {
-    return false;
+    p_Char = ((c & 0x1F) << 6) | (p_Data[1] & 0x3F);
+    return 2;
   }
-
-  return true;
-}
-
-bool Tag::Clear(const std::string& p_FilePath)
-{
-  TagLib::MPEG::File file(p_FilePath.c_str());
-  if (!file.isValid())
+  else if (((c >> 4) == 0xE) && (p_Size > 2))
   {
-    return false;
+    p_Char = ((c & 0x0F) << 12) | ((p_Data[1] & 0x3F) << 6) | (p_Data[2] & 0x3F);
+    return 3;
   }
-
-  // Remove all tag types
-  file.strip(TagLib::MPEG::File::AllTags);
-
-  if (!file.save())
+  else if (((c >> 3) == 0x1E) && (p_Size > 3))
   {
-    return false;
+    p_Char = ((c & 0x07) << 18) | ((p_Data[1] & 0x3F) << 12) | ((p_Data[2] & 0x3F) << 6) |
+      (p_Data[3] & 0x3F);
+    return 4;
   }
 
-  return true;
+  return 0;
 }
 
-static std::u32string Utf8ToUtf32(const std::string& s)
+void Tag::AppendUtf8(char32_t p_Char, std::string& p_Str)
 {
-  std::u32string out;
-  size_t i = 0;
-
-  while (i < s.size())
+  if (p_Char < 0x80)
   {
-    unsigned char c = s[i];
-
-    if (c < 0x80)
-    {
-      // 1-byte ASCII
-      out.push_back(c);
-      i++;
-    }
-    else if ((c >> 5) == 0x6 && i + 1 < s.size())
-    {
-      // 2 bytes
-      char32_t cp =
-        ((c & 0x1F) << 6) |
-        (s[i+1] & 0x3F);
-      out.push_back(cp);
-      i += 2;
-    }
-    else if ((c >> 4) == 0xE && i + 2 < s.size())
-    {
-      // 3 bytes
-      char32_t cp =
-        ((c & 0x0F) << 12) |
-        ((s[i+1] & 0x3F) << 6) |
-        (s[i+2] & 0x3F);
-      out.push_back(cp);
-      i += 3;
-    }
-    else if ((c >> 3) == 0x1E && i + 3 < s.size())
-    {
-      // 4 bytes
-      char32_t cp =
-        ((c & 0x07) << 18) |
-        ((s[i+1] & 0x3F) << 12) |
-        ((s[i+2] & 0x3F) << 6) |
-        (s[i+3] & 0x3F);
-      out.push_back(cp);
-      i += 4;
-    }
-    else
-    {
-      // malformed UTF-8 byte → skip
-      i++;
-    }
+    p_Str.push_back(static_cast<char>(p_Char));
   }
-
-  return out;
-}
-
-static std::string Utf32ToUtf8(const std::u32string& s)
-{
-  std::string out;
-
-  for (char32_t cp : s)
+  else if (p_Char < 0x800)
   {
-    if (cp < 0x80)
-    {
-      out.push_back((char)cp);
-    }
-    else if (cp < 0x800)
-    {
-      out.push_back((char)(0xC0 | (cp >> 6)));
-      out.push_back((char)(0x80 | (cp & 0x3F)));
-    }
-    else if (cp < 0x10000)
-    {
-      out.push_back((char)(0xE0 | (cp >> 12)));
-      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
-      out.push_back((char)(0x80 | (cp & 0x3F)));
-    }
-    else
-    {
-      out.push_back((char)(0xF0 | (cp >> 18)));
-      out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
-      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
-      out.push_back((char)(0x80 | (cp & 0x3F)));
-    }
+    p_Str.push_back(static_cast<char>(0xC0 | (p_Char >> 6)));
+    p_Str.push_back(static_cast<char>(0x80 | (p_Char & 0x3F)));
   }
-
-  return out;
-}
-
-std::string Tag::SanitizeFileName(const std::string& p_FileName)
-{
-  // UTF-8 → UTF-32
-  std::u32string u32 = Utf8ToUtf32(p_FileName);
-
-  std::u32string out32;
-  for (char32_t c : u32)
+  else if (p_Char < 0x10000)
   {
-    // Strip control chars and path separators
-    if ((c >= 0 && c < 0x20) || c == U'/' || c == U'\\' || c == 0x7F)
-    {
-      continue;
-    }
-
-    // Allow some nice ASCII punctuation explicitly
-    if (c == U' ' || c == U'.' || c == U',' ||
-        c == U'-' || c == U'_' || c == U'\'')
-    {
-      out32.push_back(c);
-      continue;
-    }
-
-    // On POSIX (Linux/macOS) we can safely keep all other Unicode codepoints.
-    // This preserves CJK, accents, etc. directly in the filename.
-    out32.push_back(c);
+    p_Str.push_back(static_cast<char>(0xE0 | (p_Char >> 12)));
+    p_Str.push_back(static_cast<char>(0x80 | ((p_Char >> 6) & 0x3F)));
+    p_Str.push_back(static_cast<char>(0x80 | (p_Char & 0x3F)));
+  }
+  else
+  {
+    p_Str.push_back(static_cast<char>(0xF0 | (p_Char >> 18)));
+    p_Str.push_back(static_cast<char>(0x80 | ((p_Char >> 12) & 0x3F)));
+    p_Str.push_back(static_cast<char>(0x80 | ((p_Char >> 6) & 0x3F)));
+    p_Str.push_back(static_cast<char>(0x80 | (p_Char & 0x3F)));
   }
-
-  // UTF-32 → UTF-8
-  std::string out = Utf32ToUtf8(out32);
-
-  // Whitespace and formatting cleanup
-  out = std::regex_replace(out, std::regex(" +"), "_");
-  out = std::regex_replace(out, std::regex("_+"), "_");
-  out = std::regex_replace(out, std::regex("^_+|_+$"), "");
-
-  if (out.empty())
-    out = "unnamed";
-
-  return out;
 }
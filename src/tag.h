@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 class Tag
@@ -14,12 +15,10 @@ class Tag
 public:
   static std::string MakePath(const std::string& p_FilePath, std::string& p_Artist,
                               std::string& p_Title);
-  static bool Read(const std::string& p_FilePath, std::string& p_Artist,
-                   std::string& p_Title);
-  static bool Write(const std::string& p_FilePath, const std::string& p_Artist,
-                    const std::string& p_Title);
-  static bool Clear(const std::string& p_FilePath);
+  static std::string SanitizeFileName(const std::string& p_FileName);
 
 private:
-  static std::string SanitizeFileName(const std::string& p_FileName);
+  static bool IsPlain(uint64_t p_Word);
+  static size_t DecodeUtf8(const char* p_Data, size_t p_Size, char32_t& p_Char);
+  static void AppendUtf8(char32_t p_Char, std::string& p_Str);
 };
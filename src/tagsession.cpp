@@ -0,0 +1,302 @@
+// tagsession.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#include "tagsession.h"
+
+#include <algorithm>
+
+#include <taglib/apetag.h>
+#include <taglib/id3v1tag.h>
+#include <taglib/id3v2framefactory.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/mpegfile.h>
+#include <taglib/tag.h>
+#include <taglib/taglib.h>
+
+#include "log.h"
+#include "mappedstream.h"
+#include "stats.h"
+
+TagSession::TagSession()
+{
+}
+
+TagSession::~TagSession()
+{
+}
+
+bool TagSession::Open(const std::string& p_FilePath,
+                      const std::shared_ptr<MappedFile>& p_MappedFile)
+{
+  Stats::Timer timer("tag.open");
+  Close();
+  m_FilePath = p_FilePath;
+  if (p_MappedFile)
+  {
+    m_Stream.reset(new MappedStream(p_MappedFile));
+#if TAGLIB_MAJOR_VERSION >= 2
+    m_File.reset(new TagLib::MPEG::File(m_Stream.get(), true /*readProperties*/,
+                                        TagLib::AudioProperties::Average,
+                                        TagLib::ID3v2::FrameFactory::instance()));
+#else
+    m_File.reset(new TagLib::MPEG::File(m_Stream.get(),
+                                        TagLib::ID3v2::FrameFactory::instance()));
+#endif
+  }
+  else
+  {
+    m_File.reset(new TagLib::MPEG::File(p_FilePath.c_str()));
+  }
+
+  if (!m_File->isValid())
+  {
+    Log::Debug("tag open failed for %s", p_FilePath.c_str());
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void TagSession::Close()
+{
+  // The file must be closed before the stream it reads from
+  m_File.reset();
+  m_Stream.reset();
+  m_Modified = false;
+}
+
+void TagSession::Clear()
+{
+  if (!m_File)
+  {
+    return;
+  }
+
+  // Empty all tag types in memory, save() then strips empty tags from the file
+  TagLib::ID3v2::Tag* id3v2Tag = m_File->ID3v2Tag(false);
+  if (id3v2Tag)
+  {
+    const TagLib::ID3v2::FrameList frames = id3v2Tag->frameList();
+    for (auto frame : frames)
+    {
+      id3v2Tag->removeFrame(frame, true /*del*/);
+    }
+  }
+
+  TagLib::ID3v1::Tag* id3v1Tag = m_File->ID3v1Tag(false);
+  if (id3v1Tag)
+  {
+    id3v1Tag->setTitle(TagLib::String());
+    id3v1Tag->setArtist(TagLib::String());
+    id3v1Tag->setAlbum(TagLib::String());
+    id3v1Tag->setComment(TagLib::String());
+    id3v1Tag->setGenre(TagLib::String());
+    id3v1Tag->setYear(0);
+    id3v1Tag->setTrack(0);
+  }
+
+  TagLib::APE::Tag* apeTag = m_File->APETag(false);
+  if (apeTag)
+  {
+    const TagLib::APE::ItemListMap items = apeTag->itemListMap();
+    for (auto it = items.begin(); it != items.end(); ++it)
+    {
+      apeTag->removeItem(it->first);
+    }
+  }
+
+  m_Modified = true;
+}
+
+bool TagSession::Read(std::string& p_Artist, std::string& p_Title)
+{
+  if (!m_File)
+  {
+    return false;
+  }
+
+  // Prefer ID3v2 tag; if not present, fall back to generic tag (e.g. ID3v1)
+  TagLib::Tag* tag = m_File->ID3v2Tag(false);
+  if (!tag)
+  {
+    tag = m_File->tag();
+  }
+
+  if (!tag)
+  {
+    return false;
+  }
+
+  // true => return UTF-8 in Unicode-aware builds
+  p_Artist = tag->artist().to8Bit(true);
+  p_Title = tag->title().to8Bit(true);
+
+  if (p_Artist.empty() || p_Title.empty())
+  {
+    return false;
+  }
+
+  return true;
+}
+
+bool TagSession::Write(const std::string& p_Artist, const std::string& p_Title)
+{
+  if (!m_File)
+  {
+    return false;
+  }
+
+  const TagLib::String artist(p_Artist, TagLib::String::UTF8);
+  const TagLib::String title(p_Title, TagLib::String::UTF8);
+
+  // Skip the save when an existing ID3v2 tag already holds the same values
+  TagLib::ID3v2::Tag* tag = m_File->ID3v2Tag(false);
+  if (tag && (tag->artist() == artist) && (tag->title() == title))
+  {
+    return true;
+  }
+
+  tag = m_File->ID3v2Tag(true);
+  if (!tag)
+  {
+    return false;
+  }
+
+  tag->setArtist(artist);
+  tag->setTitle(title);
+  m_Modified = true;
+
+  return true;
+}
+
+bool TagSession::Save(int p_Padding)
+{
+  if (!m_File)
+  {
+    return false;
+  }
+
+  if (!m_Modified)
+  {
+    return true;
+  }
+
+  Stats::Timer timer("tag.save");
+  TagLib::ID3v2::Tag* tag = m_File->ID3v2Tag(false);
+  const bool padded = (p_Padding > 0) && tag && !tag->isEmpty();
+  if (!(padded ? SavePadded(p_Padding) : SaveDefault()))
+  {
+    return false;
+  }
+
+  m_Modified = false;
+  return true;
+}
+
+bool TagSession::SaveDefault()
+{
+  // TagLib pads a tag that shrinks to keep its size, any other size change moves the audio
+  const size_t oldSize = GetTagSize();
+  TagLib::ID3v2::Tag* tag = m_File->ID3v2Tag(false);
+  const size_t newSize = (tag && !tag->isEmpty()) ? tag->render().size() : 0;
+  if (!m_File->save())
+  {
+    return false;
+  }
+
+  Stats::AddCount((newSize != oldSize) ? "tag.rewrite" : "tag.inplace");
+  return true;
+}
+
+bool TagSession::SavePadded(int p_Padding)
+{
+  // ID3v1 and APE tags are at the end of the file, saving them never moves the audio
+#if TAGLIB_MAJOR_VERSION >= 2
+  const bool saved = m_File->save(TagLib::MPEG::File::ID3v1 | TagLib::MPEG::File::APE,
+                                  TagLib::File::StripNone);
+#else
+  const bool saved = m_File->save(TagLib::MPEG::File::ID3v1 | TagLib::MPEG::File::APE,
+                                  false /*stripOthers*/);
+#endif
+  if (!saved)
+  {
+    return false;
+  }
+
+  TagLib::ByteVector data = m_File->ID3v2Tag(false)->render();
+  const size_t framesSize = GetFramesSize(data.data(), data.size());
+  const size_t oldSize = GetTagSize();
+  const bool inPlace = (framesSize <= oldSize);
+  const size_t newSize = inPlace ? oldSize : (framesSize + static_cast<size_t>(p_Padding));
+
+  // Header and frames followed by zeroed padding, replacing any footer
+  data.resize(static_cast<unsigned int>(framesSize));
+  data.resize(static_cast<unsigned int>(newSize), '\0');
+  data.data()[5] = static_cast<char>(data.data()[5] & ~0x10);
+  SetSyncSafe(data.data() + 6, newSize - 10);
+  m_File->insert(data, 0, static_cast<unsigned long>(oldSize));
+  Stats::AddCount(inPlace ? "tag.inplace" : "tag.rewrite");
+
+  // Tag offsets held by TagLib are stale once the audio has moved
+  if (!inPlace)
+  {
+    m_File.reset(new TagLib::MPEG::File(m_FilePath.c_str()));
+    m_Stream.reset();
+    if (!m_File->isValid())
+    {
+      m_File.reset();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t TagSession::GetTagSize()
+{
+  // Only a tag at the start of the file is counted, as written by TagLib and idntag
+  m_File->seek(0);
+  const TagLib::ByteVector header = m_File->readBlock(10);
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(header.data());
+  if ((header.size() < 10) || (data[0] != 'I') || (data[1] != 'D') || (data[2] != '3'))
+  {
+    return 0;
+  }
+
+  const size_t size = (static_cast<size_t>(data[6] & 0x7f) << 21) |
+                      (static_cast<size_t>(data[7] & 0x7f) << 14) |
+                      (static_cast<size_t>(data[8] & 0x7f) << 7) |
+                      static_cast<size_t>(data[9] & 0x7f);
+  const bool hasFooter = (data[5] & 0x10) != 0;
+  return 10 + size + (hasFooter ? 10 : 0);
+}
+
+size_t TagSession::GetFramesSize(const char* p_Data, size_t p_Size)
+{
+  // Walk the ID3v2.4 frames rendered by TagLib up to the padding, or the end of the tag
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(p_Data);
+  size_t pos = 10;
+  while (((pos + 10) <= p_Size) && (data[pos] != 0))
+  {
+    const size_t frameSize = (static_cast<size_t>(data[pos + 4] & 0x7f) << 21) |
+                             (static_cast<size_t>(data[pos + 5] & 0x7f) << 14) |
+                             (static_cast<size_t>(data[pos + 6] & 0x7f) << 7) |
+                             static_cast<size_t>(data[pos + 7] & 0x7f);
+    pos += 10 + frameSize;
+  }
+
+  return std::min(pos, p_Size);
+}
+
+void TagSession::SetSyncSafe(char* p_Data, size_t p_Value)
+{
+  p_Data[0] = static_cast<char>((p_Value >> 21) & 0x7f);
+  p_Data[1] = static_cast<char>((p_Value >> 14) & 0x7f);
+  p_Data[2] = static_cast<char>((p_Value >> 7) & 0x7f);
+  p_Data[3] = static_cast<char>(p_Value & 0x7f);
+}
@@ -0,0 +1,54 @@
+// tagsession.h
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace TagLib
+{
+  namespace MPEG
+  {
+    class File;
+  }
+}
+
+class MappedFile;
+class MappedStream;
+
+// Keeps one file open and parsed while its tags are cleared, read and updated in memory,
+// writing changes back with a single save. Files are parsed from a memory mapping when
+// given. A non-zero padding reserves space after the ID3v2 frames whenever the tag must
+// grow, so later edits overwrite the tag in place.
+class TagSession
+{
+public:
+  TagSession();
+  ~TagSession();
+
+  bool Open(const std::string& p_FilePath, const std::shared_ptr<MappedFile>& p_MappedFile);
+  void Close();
+  void Clear();
+  bool Read(std::string& p_Artist, std::string& p_Title);
+  bool Write(const std::string& p_Artist, const std::string& p_Title);
+  bool Save(int p_Padding);
+
+private:
+  bool SaveDefault();
+  bool SavePadded(int p_Padding);
+  size_t GetTagSize();
+  static size_t GetFramesSize(const char* p_Data, size_t p_Size);
+  static void SetSyncSafe(char* p_Data, size_t p_Value);
+
+private:
+  std::string m_FilePath;
+  std::unique_ptr<MappedStream> m_Stream;
+  std::unique_ptr<TagLib::MPEG::File> m_File;
+  bool m_Modified = false;
+};
@@ -7,30 +7,89 @@
 
 #include "util.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <filesystem>
 #include <sstream>
 
-Util::RateLimiter::RateLimiter(std::chrono::milliseconds minInterval)
-  : m_MinInterval(minInterval)
-  , m_LastCall(std::chrono::steady_clock::time_point::min())
+Util::RateLimiter::RateLimiter(double p_Rate, double p_Burst)
 {
+  SetRate(p_Rate, p_Burst);
 }
 
-void Util::RateLimiter::Wait()
+void Util::RateLimiter::SetRate(double p_Rate, double p_Burst)
 {
-  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_MaxRate = p_Rate;
+  m_Rate = p_Rate;
+  m_Burst = std::max(p_Burst, 1.0);
+  m_Tokens = 1.0;
+  m_LastRefill = std::chrono::steady_clock::now();
+  m_PausedUntil = m_LastRefill;
+}
 
-  if (m_LastCall != std::chrono::steady_clock::time_point::min())
+void Util::RateLimiter::Wait()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while (true)
   {
-    auto nextAllowed = m_LastCall + m_MinInterval;
-    if (now < nextAllowed)
+    const auto now = std::chrono::steady_clock::now();
+    Refill(now);
+    if ((now >= m_PausedUntil) && (m_Tokens >= 1.0))
     {
-      std::this_thread::sleep_for(nextAllowed - now);
+      m_Tokens -= 1.0;
+      return;
     }
+
+    std::chrono::steady_clock::duration delay = m_PausedUntil - now;
+    if (now >= m_PausedUntil)
+    {
+      delay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>((1.0 - m_Tokens) / m_Rate));
+    }
+
+    lock.unlock();
+    std::this_thread::sleep_for(delay);
+    lock.lock();
   }
+}
 
-  m_LastCall = std::chrono::steady_clock::now();
+void Util::RateLimiter::OnSuccess()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (m_Rate < m_MaxRate)
+  {
+    Refill(std::chrono::steady_clock::now());
+    m_Rate = std::min(m_MaxRate, m_Rate + (m_MaxRate / 10.0));
+  }
+}
+
+void Util::RateLimiter::OnThrottle(long p_RetryAfterSec)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const auto now = std::chrono::steady_clock::now();
+  Refill(now);
+  m_Rate = std::max(m_MaxRate / 64.0, m_Rate / 2.0);
+  m_Tokens = 0.0;
+  const auto pausedUntil = now + std::chrono::seconds(std::max(p_RetryAfterSec, 1L));
+  m_PausedUntil = std::max(m_PausedUntil, pausedUntil);
+}
+
+void Util::RateLimiter::Refill(std::chrono::steady_clock::time_point p_Now)
+{
+  if (p_Now > m_LastRefill)
+  {
+    const double elapsedSec = std::chrono::duration<double>(p_Now - m_LastRefill).count();
+    m_Tokens = std::min(m_Burst, m_Tokens + (elapsedSec * m_Rate));
+    m_LastRefill = p_Now;
+  }
 }
 
 bool Util::Exists(const std::string& p_Path)
@@ -39,6 +98,35 @@ bool Util::Exists(const std::string& p_Path)
          (std::filesystem::is_regular_file(p_Path) || std::filesystem::is_directory(p_Path));
 }
 
+std::string Util::GetCacheDir()
+{
+  std::filesystem::path base;
+  const char* xdgCacheHome = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  if ((xdgCacheHome != nullptr) && (*xdgCacheHome != '\0'))
+  {
+    base = xdgCacheHome;
+  }
+  else if ((home != nullptr) && (*home != '\0'))
+  {
+    base = std::filesystem::path(home) / ".cache";
+  }
+  else
+  {
+    return "";
+  }
+
+  const std::filesystem::path dir = base / "idntag";
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec)
+  {
+    return "";
+  }
+
+  return dir.string();
+}
+
 std::string Util::GetFileExt(const std::string& p_Path)
 {
   size_t lastPeriod = p_Path.find_last_of(".");
@@ -47,59 +135,57 @@ std::string Util::GetFileExt(const std::string& p_Path)
   return p_Path.substr(lastPeriod);
 }
 
-void Util::ListFiles(const std::string& p_Path, std::set<std::string>& p_Paths)
+bool Util::RenameNoReplace(const std::string& p_OldPath, const std::string& p_NewPath,
+                           bool& p_Exists)
 {
-  std::filesystem::path path(p_Path);
-  if (std::filesystem::is_regular_file(path))
+  p_Exists = false;
+  const char* oldPath = p_OldPath.c_str();
+  const char* newPath = p_NewPath.c_str();
+#if defined(__APPLE__)
+  int rv = renamex_np(oldPath, newPath, RENAME_EXCL);
+#elif defined(RENAME_NOREPLACE)
+  int rv = renameat2(AT_FDCWD, oldPath, AT_FDCWD, newPath, RENAME_NOREPLACE);
+#else
+  int rv = -1;
+  errno = ENOSYS;
+#endif
+  if (rv == 0)
   {
-    p_Paths.insert(std::filesystem::canonical(path).string());
+    return true;
   }
-  else if (std::filesystem::is_directory(path))
+
+  if (errno == EEXIST)
   {
-    for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
-    {
-      if (entry.is_regular_file())
-      {
-        p_Paths.insert(std::filesystem::canonical(entry.path()).string());
-      }
-    }
+    p_Exists = true;
+    return false;
   }
-}
-
-std::string Util::MakeReport(const std::string& p_Format, const std::string& p_InFilePath,
-                             const std::string& p_OutFilePath, bool p_Result)
-{
-  std::string report = p_Format;
 
-  Replace(report, "%i", p_InFilePath);
-  Replace(report, "%o", p_OutFilePath);
-  Replace(report, "%r", p_Result ? "PASS" : "FAIL");
-
-  return report;
-}
-
-void Util::Replace(std::string& p_Str, const std::string& p_Search,
-                   const std::string& p_Replace)
-{
-  size_t pos = 0;
-  while ((pos = p_Str.find(p_Search, pos)) != std::string::npos)
+  if ((errno != EINVAL) && (errno != ENOSYS) && (errno != ENOTSUP))
   {
-    p_Str.replace(pos, p_Search.length(), p_Replace);
-    pos += p_Replace.length();
+    return false;
   }
-}
 
-bool Util::Rename(const std::string& p_OldPath, const std::string& p_NewPath)
-{
-  try
+  // Not supported by the filesystem, linking does not replace an existing file either
+  if (link(oldPath, newPath) == 0)
   {
-    std::filesystem::rename(std::filesystem::path(p_OldPath), std::filesystem::path(p_NewPath));
+    unlink(oldPath);
     return true;
   }
-  catch (const std::filesystem::filesystem_error&)
+
+  if (errno == EEXIST)
+  {
+    p_Exists = true;
+    return false;
+  }
+
+  // Last resort for filesystems without hard links
+  if (std::filesystem::exists(p_NewPath))
   {
+    p_Exists = true;
     return false;
   }
+
+  return rename(oldPath, newPath) == 0;
 }
 
 std::string Util::RunCommand(const std::string& p_Cmd)
@@ -139,9 +225,244 @@ std::string Util::StrFromHex(const std::string& p_String)
   return result;
 }
 
+bool Util::ToDouble(const std::string& p_Str, double& p_Double)
+{
+  if (p_Str.empty())
+  {
+    return false;
+  }
+
+  char* end = nullptr;
+  errno = 0;
+  const double val = strtod(p_Str.c_str(), &end);
+  if ((errno != 0) || (*end != '\0'))
+  {
+    return false;
+  }
+
+  p_Double = val;
+  return true;
+}
+
+bool Util::ToInt(const std::string& p_Str, int& p_Int)
+{
+  if (p_Str.empty())
+  {
+    return false;
+  }
+
+  char* end = nullptr;
+  errno = 0;
+  const long val = strtol(p_Str.c_str(), &end, 10);
+  if ((errno != 0) || (*end != '\0') || (val < INT_MIN) || (val > INT_MAX))
+  {
+    return false;
+  }
+
+  p_Int = static_cast<int>(val);
+  return true;
+}
+
+bool Util::ToTime(const std::string& p_Str, int64_t& p_TimeSec)
+{
+  // Local date, optionally with time of day, e.g. 2025-01-31 or 2025-01-31T23:59:59
+  static const char* formats[] = { "%Y-%m-%d", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M:%S" };
+  for (const char* format : formats)
+  {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(p_Str.c_str(), format, &tm);
+    if ((end != nullptr) && (*end == '\0'))
+    {
+      tm.tm_isdst = -1;
+      const time_t timeSec = mktime(&tm);
+      if (timeSec == static_cast<time_t>(-1))
+      {
+        return false;
+      }
+
+      p_TimeSec = static_cast<int64_t>(timeSec);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+std::string Util::UrlEncode(const std::string& p_Str)
+{
+  static const char* hex = "0123456789ABCDEF";
+  std::string encoded;
+  encoded.reserve(p_Str.size());
+  for (const char ch : p_Str)
+  {
+    const unsigned char c = static_cast<unsigned char>(ch);
+    if (isalnum(c) || (c == '-') || (c == '.') || (c == '_') || (c == '~'))
+    {
+      encoded += static_cast<char>(c);
+    }
+    else
+    {
+      encoded += '%';
+      encoded += hex[c >> 4];
+      encoded += hex[c & 0xf];
+    }
+  }
+
+  return encoded;
+}
+
 std::string Util::ToLower(const std::string& p_Str)
 {
   std::string lower = p_Str;
   std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
   return lower;
 }
+
+std::u32string Util::Utf8ToUtf32(const std::string& p_Str)
+{
+  std::u32string out;
+  size_t i = 0;
+
+  while (i < p_Str.size())
+  {
+    unsigned char c = p_Str[i];
+
+    if (c < 0x80)
+    {
+      // 1-byte ASCII
+      out.push_back(c);
+      i++;
+    }
+    else if ((c >> 5) == 0x6 && i + 1 < p_Str.size())
+    {
+      // 2 bytes
+      char32_t cp =
+        ((c & 0x1F) << 6) |
+        (p_Str[i+1] & 0x3F);
+      out.push_back(cp);
+      i += 2;
+    }
+    else if ((c >> 4) == 0xE && i + 2 < p_Str.size())
+    {
+      // 3 bytes
+      char32_t cp =
+        ((c & 0x0F) << 12) |
+        ((p_Str[i+1] & 0x3F) << 6) |
+        (p_Str[i+2] & 0x3F);
+      out.push_back(cp);
+      i += 3;
+    }
+    else if ((c >> 3) == 0x1E && i + 3 < p_Str.size())
+    {
+      // 4 bytes
+      char32_t cp =
+        ((c & 0x07) << 18) |
+        ((p_Str[i+1] & 0x3F) << 12) |
+        ((p_Str[i+2] & 0x3F) << 6) |
+        (p_Str[i+3] & 0x3F);
+      out.push_back(cp);
+      i += 4;
+    }
+    else
+    {
+      // malformed UTF-8 byte → skip
+      i++;
+    }
+  }
+
+  return out;
+}
+
+std::string Util::Utf32ToUtf8(const std::u32string& p_Str)
+{
+  std::string out;
+
+  for (char32_t cp : p_Str)
+  {
+    if (cp < 0x80)
+    {
+      out.push_back((char)cp);
+    }
+    else if (cp < 0x800)
+    {
+      out.push_back((char)(0xC0 | (cp >> 6)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000)
+    {
+      out.push_back((char)(0xE0 | (cp >> 12)));
+      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+      out.push_back((char)(0xF0 | (cp >> 18)));
+      out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+  }
+
+  return out;
+}
+
+std::string Util::ToValidUtf8(const std::string& p_Str)
+{
+  // Truncated, overlong, surrogate and out of range sequences are replaced byte by byte
+  std::string out;
+  out.reserve(p_Str.size());
+  size_t i = 0;
+  while (i < p_Str.size())
+  {
+    const unsigned char c = p_Str[i];
+    if (c < 0x80)
+    {
+      out.push_back((char)c);
+      ++i;
+      continue;
+    }
+
+    size_t len = 0;
+    uint32_t cp = 0;
+    uint32_t minCp = 0;
+    if ((c & 0xE0) == 0xC0)
+    {
+      len = 2;
+      cp = c & 0x1F;
+      minCp = 0x80;
+    }
+    else if ((c & 0xF0) == 0xE0)
+    {
+      len = 3;
+      cp = c & 0x0F;
+      minCp = 0x800;
+    }
+    else if ((c & 0xF8) == 0xF0)
+    {
+      len = 4;
+      cp = c & 0x07;
+      minCp = 0x10000;
+    }
+
+    size_t n = 1;
+    while ((n < len) && ((i + n) < p_Str.size()) && ((p_Str[i + n] & 0xC0) == 0x80))
+    {
+      cp = (cp << 6) | (p_Str[i + n] & 0x3F);
+      ++n;
+    }
+
+    if ((len == 0) || (n < len) || (cp < minCp) || (cp > 0x10FFFF) ||
+        ((cp >= 0xD800) && (cp < 0xE000)))
+    {
+      out.append("\xEF\xBF\xBD");
+      ++i;
+      continue;
+    }
+
+    out.append(p_Str, i, len);
+    i += len;
+  }
+
+  return out;
+}
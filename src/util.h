@@ -8,34 +8,52 @@
 #pragma once
 
 #include <chrono>
-#include <set>
+#include <cstdint>
+#include <mutex>
 #include <string>
 #include <thread>
 
 class Util
 {
 public:
+  // Thread-safe token bucket. The rate is halved when the server throttles requests,
+  // and then increased step by step back up to the configured rate (AIMD).
   class RateLimiter
   {
   public:
-    explicit RateLimiter(std::chrono::milliseconds minInterval);
+    RateLimiter(double p_Rate, double p_Burst);
+    void SetRate(double p_Rate, double p_Burst);
     void Wait();
+    void OnSuccess();
+    void OnThrottle(long p_RetryAfterSec);
 
   private:
-    std::chrono::milliseconds m_MinInterval;
-    std::chrono::steady_clock::time_point m_LastCall;
+    void Refill(std::chrono::steady_clock::time_point p_Now);
+
+  private:
+    double m_MaxRate = 0.0;
+    double m_Rate = 0.0;
+    double m_Burst = 0.0;
+    double m_Tokens = 0.0;
+    std::chrono::steady_clock::time_point m_LastRefill;
+    std::chrono::steady_clock::time_point m_PausedUntil;
+    std::mutex m_Mutex;
   };
 
 public:
   static bool Exists(const std::string& p_Path);
+  static std::string GetCacheDir();
   static std::string GetFileExt(const std::string& p_Path);
-  static void ListFiles(const std::string& p_Path, std::set<std::string>& p_Paths);
-  static std::string MakeReport(const std::string& p_Format, const std::string& p_InFilePath,
-                                const std::string& OutFilePath, bool p_Result);
-  static void Replace(std::string& p_Str, const std::string& p_Search,
-                      const std::string& p_Replace);
-  static bool Rename(const std::string& p_OldPath, const std::string& p_NewPath);
+  static bool RenameNoReplace(const std::string& p_OldPath, const std::string& p_NewPath,
+                              bool& p_Exists);
   static std::string RunCommand(const std::string& p_Cmd);
   static std::string StrFromHex(const std::string& p_String);
+  static bool ToDouble(const std::string& p_Str, double& p_Double);
+  static bool ToInt(const std::string& p_Str, int& p_Int);
+  static bool ToTime(const std::string& p_Str, int64_t& p_TimeSec);
+  static std::string UrlEncode(const std::string& p_Str);
   static std::string ToLower(const std::string& p_Str);
+  static std::u32string Utf8ToUtf32(const std::string& p_Str);
+  static std::string Utf32ToUtf8(const std::u32string& p_Str);
+  static std::string ToValidUtf8(const std::string& p_Str);
 };
@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+
+# mockacoustid.py - local stand-in for the AcoustID lookup API
+#
+# Answers lookups (single and batched) with made-up recordings derived from the
+# fingerprint, with configurable latency, error rate and rate limiting, for
+# running idntag offline and reproducibly:
+#
+#   ./mockacoustid.py --port 8080 --latency 100 --rate 3 &
+#   idntag -n -d --endpoint http://127.0.0.1:8080/v2/lookup PATHS...
+
+import argparse
+import hashlib
+import json
+import os
+import random
+import signal
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.requests = 0
+        self.fingerprints = 0
+        self.throttled = 0
+        self.errors = 0
+        self.latencies = []
+
+    def add(self, status, fingerprints, latency):
+        with self.lock:
+            self.requests += 1
+            self.fingerprints += fingerprints
+            self.throttled += 1 if status == 429 else 0
+            self.errors += 1 if status >= 500 else 0
+            self.latencies.append(latency)
+
+    def report(self):
+        with self.lock:
+            latencies = sorted(self.latencies)
+
+            def percentile(p):
+                if not latencies:
+                    return 0.0
+                return latencies[min(len(latencies) - 1, int(p * len(latencies)))] * 1000
+
+            return json.dumps({"requests": self.requests, "fingerprints": self.fingerprints,
+                               "throttled": self.throttled, "errors": self.errors,
+                               "latency_ms_p50": round(percentile(0.50), 3),
+                               "latency_ms_p95": round(percentile(0.95), 3),
+                               "latency_ms_p99": round(percentile(0.99), 3),
+                               "latency_ms_max": round(percentile(1.0), 3)})
+
+
+class TokenBucket:
+    def __init__(self, rate, burst):
+        self.lock = threading.Lock()
+        self.rate = rate
+        self.burst = burst
+        self.tokens = burst
+        self.last = time.monotonic()
+
+    def take(self):
+        if self.rate <= 0:
+            return True
+        with self.lock:
+            now = time.monotonic()
+            self.tokens = min(self.burst, self.tokens + (now - self.last) * self.rate)
+            self.last = now
+            if self.tokens >= 1.0:
+                self.tokens -= 1.0
+                return True
+            return False
+
+
+def make_results(fingerprint, args, rng):
+    if rng.random() < args.empty_rate:
+        return []
+    digest = hashlib.sha1(fingerprint.encode()).hexdigest()
+    return [{"id": digest, "score": 0.9,
+             "recordings": [{"id": digest[:8], "title": "Track " + digest[:8],
+                             "artists": [{"name": args.artist}]}]}]
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):
+        if self.server.args.verbose:
+            super().log_message(format, *args)
+
+    def send(self, status, doc, headers=None):
+        body = json.dumps(doc).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        for key, value in (headers or {}).items():
+            self.send_header(key, value)
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        start = time.monotonic()
+        args = self.server.args
+        length = int(self.headers.get("Content-Length", 0))
+        params = parse_qs(self.rfile.read(length).decode())
+        with self.server.rng_lock:
+            rng = random.Random(self.server.rng.random())
+
+        if args.latency > 0 or args.jitter > 0:
+            time.sleep((args.latency + rng.expovariate(1.0 / args.jitter) if args.jitter > 0
+                        else args.latency) / 1000.0)
+
+        fingerprints = []
+        if "fingerprint" in params:
+            fingerprints = [(None, params["fingerprint"][0])]
+        else:
+            keys = sorted((k for k in params if k.startswith("fingerprint.")),
+                          key=lambda k: int(k.split(".")[1]))
+            fingerprints = [(int(k.split(".")[1]), params[k][0]) for k in keys]
+
+        if not self.server.bucket.take():
+            status = 429
+            self.send(status, {"status": "error", "error": {"code": 14, "message": "rate limit"}},
+                      {"Retry-After": str(args.retry_after)})
+        elif rng.random() < args.error_rate:
+            status = 503
+            self.send(status, {"status": "error", "error": {"code": 5, "message": "mock error"}})
+        elif self.path != args.path or not fingerprints or "client" not in params:
+            status = 400
+            self.send(status, {"status": "error", "error": {"code": 2, "message": "bad request"}})
+        elif fingerprints[0][0] is None:
+            status = 200
+            self.send(status, {"status": "ok",
+                               "results": make_results(fingerprints[0][1], args, rng)})
+        else:
+            status = 200
+            self.send(status, {"status": "ok",
+                               "fingerprints": [{"index": index,
+                                                 "results": make_results(fp, args, rng)}
+                                                for index, fp in fingerprints]})
+
+        self.server.stats.add(status, len(fingerprints), time.monotonic() - start)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local stand-in for the AcoustID lookup API.")
+    parser.add_argument("--port", type=int, default=0, help="port to listen on (default any)")
+    parser.add_argument("--port-file", help="write the port to this file once listening")
+    parser.add_argument("--path", default="/v2/lookup", help="lookup path (default /v2/lookup)")
+    parser.add_argument("--latency", type=float, default=0, help="added latency in ms")
+    parser.add_argument("--jitter", type=float, default=0,
+                        help="mean of exponentially distributed extra latency in ms")
+    parser.add_argument("--error-rate", type=float, default=0,
+                        help="fraction of requests failing with 503")
+    parser.add_argument("--empty-rate", type=float, default=0,
+                        help="fraction of fingerprints without results")
+    parser.add_argument("--rate", type=float, default=0,
+                        help="max requests per second before 429 (default unlimited)")
+    parser.add_argument("--burst", type=float, default=1, help="max requests in a burst")
+    parser.add_argument("--retry-after", type=int, default=1,
+                        help="Retry-After seconds sent with 429")
+    parser.add_argument("--artist", default="Mock Artist", help="artist of all results")
+    parser.add_argument("--seed", type=int, default=0, help="random seed")
+    parser.add_argument("--verbose", action="store_true", help="log each request")
+    args = parser.parse_args()
+
+    server = ThreadingHTTPServer(("127.0.0.1", args.port), Handler)
+    server.daemon_threads = True
+    server.args = args
+    server.rng = random.Random(args.seed)
+    server.rng_lock = threading.Lock()
+    server.bucket = TokenBucket(args.rate, max(args.burst, 1))
+    server.stats = Stats()
+
+    port = server.server_address[1]
+    if args.port_file:
+        with open(args.port_file + ".tmp", "w") as f:
+            f.write(str(port))
+        # Rename to make the file appear complete
+        os.rename(args.port_file + ".tmp", args.port_file)
+    print("listening on http://127.0.0.1:%d%s" % (port, args.path), file=sys.stderr, flush=True)
+
+    signal.signal(signal.SIGTERM, lambda signum, frame: sys.exit(0))
+    try:
+        server.serve_forever()
+    except (KeyboardInterrupt, SystemExit):
+        pass
+    finally:
+        print(server.stats.report(), flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+// test010.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+// test010 - differential test of Tag::SanitizeFileName against the previous
+// regex-based implementation, on fixed and random UTF-8 / malformed input
+
+#include <cstdio>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "tag.h"
+#include "util.h"
+
+static std::string LegacySanitizeFileName(const std::string& p_FileName)
+{
+  std::u32string u32 = Util::Utf8ToUtf32(p_FileName);
+
+  std::u32string out32;
+  for (char32_t c : u32)
+  {
+    if ((c < 0x20) || c == U'/' || c == U'\\' || c == 0x7F)
+    {
+      continue;
+    }
+
+    out32.push_back(c);
+  }
+
+  std::string out = Util::Utf32ToUtf8(out32);
+
+  out = std::regex_replace(out, std::regex(" +"), "_");
+  out = std::regex_replace(out, std::regex("_+"), "_");
+  out = std::regex_replace(out, std::regex("^_+|_+$"), "");
+
+  if (out.empty())
+    out = "unnamed";
+
+  return out;
+}
+
+static std::string ToHex(const std::string& p_Str)
+{
+  std::string hex;
+  char buf[4];
+  for (unsigned char c : p_Str)
+  {
+    snprintf(buf, sizeof(buf), "%02x ", c);
+    hex += buf;
+  }
+
+  return hex;
+}
+
+int main()
+{
+  std::vector<std::string> inputs =
+  {
+    "", " ", "_", "__ __", "Broke For Free", "  Night   Owl  ", "a/b\\c", "AC/DC",
+    "Dariusz Jackowski", "Łódź", "夜想曲", "Sigur Rós _ Hoppípolla", "tab\there",
+    "del\x7f", "x\xc0\xa0y", "x\xc1\x9fy", "\xc0\xaf", "\xe0\x80\xa0", "trunc\xe6\x97",
+    "\xf7\xbf\xbf\xbf", "\xff\xfe", "emoji \xf0\x9f\x8e\xb5 track", "\xc3" "A",
+    "abcdefgh", "abcdefg_", "_abcdefghijklmnop_", "abcdefgh ijklmnop qrstuvwx",
+  };
+
+  // Random strings mixing plain ASCII runs with bytes and sequences that need handling
+  const std::vector<std::string> pieces =
+  {
+    "a", "Z", "0", ".", ",", "-", "'", "(", " ", "_", "/", "\\", "\x01", "\x1f", "\x7f",
+    "ab", "Track Name", "abcdefghijklmnop", "é", "ß", "ø", "夜", "曲", "\xf0\x9f\x8e\xb5",
+    "\x80", "\xbf", "\xc0", "\xc2", "\xe3", "\xf0", "\xf8", "\xff", "\xc0\xa0", "\xc1\x9f",
+    "\xe0\x80\xaf", "\xf0\x80\x80\x81",
+  };
+
+  std::mt19937 rng(12345);
+  std::uniform_int_distribution<size_t> pieceDist(0, pieces.size() - 1);
+  std::uniform_int_distribution<int> countDist(0, 24);
+  for (int i = 0; i < 20000; ++i)
+  {
+    std::string input;
+    const int count = countDist(rng);
+    for (int j = 0; j < count; ++j)
+    {
+      input += pieces[pieceDist(rng)];
+    }
+
+    inputs.push_back(input);
+  }
+
+  int failures = 0;
+  for (const auto& input : inputs)
+  {
+    const std::string expected = LegacySanitizeFileName(input);
+    const std::string actual = Tag::SanitizeFileName(input);
+    if (actual != expected)
+    {
+      if (++failures <= 10)
+      {
+        printf("input    %s\nexpected %s\nactual   %s\n\n", ToHex(input).c_str(),
+               ToHex(expected).c_str(), ToHex(actual).c_str());
+      }
+    }
+  }
+
+  if (failures > 0)
+  {
+    printf("%d of %zu inputs differ\n", failures, inputs.size());
+    return 1;
+  }
+
+  return 0;
+}
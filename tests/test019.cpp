@@ -0,0 +1,160 @@
+// test019.cpp
+//
+// Copyright (c) 2025 Kristofer Berggren
+// All rights reserved.
+//
+// idntag is distributed under the MIT license, see LICENSE for details.
+
+// test019 - LookupParser on escapes, surrogate pairs, invalid UTF-8, nested payloads, batch
+// index order, truncated input and the response size limit, fed whole and in small chunks
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "lookupparser.h"
+
+struct Case
+{
+  std::string name;
+  size_t count;
+  std::string body;
+  bool ok;
+  std::string expected;
+};
+
+static std::string Describe(const std::vector<std::vector<AcoustId::Match>>& p_Matches)
+{
+  // Matches as artist|title|score, separated by ; within and / between fingerprints
+  std::string str;
+  for (size_t i = 0; i < p_Matches.size(); ++i)
+  {
+    str += (i > 0) ? "/" : "";
+    for (const auto& match : p_Matches[i])
+    {
+      char score[32];
+      snprintf(score, sizeof(score), "%.2f", match.score);
+      str += match.artist + "|" + match.title + "|" + score + ";";
+    }
+  }
+
+  return str;
+}
+
+static bool Parse(size_t p_Count, const std::string& p_Body, size_t p_ChunkSize,
+                  std::string& p_Matches)
+{
+  LookupParser parser(p_Count);
+  for (size_t offset = 0; offset < p_Body.size(); offset += p_ChunkSize)
+  {
+    parser.Feed(p_Body.data() + offset, std::min(p_ChunkSize, p_Body.size() - offset));
+  }
+
+  std::vector<std::vector<AcoustId::Match>> matches;
+  const bool ok = parser.Finish(matches);
+  p_Matches = ok ? Describe(matches) : "";
+  return ok;
+}
+
+static std::string Result(const std::string& p_Artist, const std::string& p_Title,
+                          const std::string& p_Score)
+{
+  return "{\"id\": \"r\", \"score\": " + p_Score + ", \"recordings\": [{\"title\": \"" +
+    p_Title + "\", \"artists\": [{\"name\": \"" + p_Artist + "\"}]}]}";
+}
+
+int main()
+{
+  std::vector<Case> cases =
+  {
+    { "escapes", 1,
+      "{\"status\": \"ok\", \"results\": [" +
+      Result("\\\"A\\\\B\\/C\\b\\f\\n\\r\\t", "T\\u00e9\\u00E9\\u0041", "0.5") + "]}",
+      true, "\"A\\B/C\b\f\n\r\t|TééA|0.50;" },
+    { "surrogates", 1,
+      "{\"status\": \"ok\", \"results\": [" +
+      Result("\\ud83c\\udfb5", "x\\ud83cy\\udfb5z\\ud83c", "1") + "]}",
+      true, "\xf0\x9f\x8e\xb5|x\xef\xbf\xbdy\xef\xbf\xbdz\xef\xbf\xbd|1.00;" },
+    { "invalid utf-8", 1,
+      "{\"status\": \"ok\", \"results\": [" +
+      Result("a\xff" "b", "c\xc0\xaf" "d\xed\xa0\x80" "e\xe6\x97", "1") + "]}",
+      true, "a\xef\xbf\xbd" "b|c\xef\xbf\xbd\xef\xbf\xbd" "d\xef\xbf\xbd\xef\xbf\xbd"
+      "\xef\xbf\xbd" "e\xef\xbf\xbd\xef\xbf\xbd|1.00;" },
+    { "nested", 1,
+      "{\"status\": \"ok\", \"results\": ["
+      "{\"id\": \"a\", \"score\": 0.9, \"recordings\": [{\"id\": \"r\", \"title\": \"T1\", "
+      "\"artists\": [{\"name\": \"A1\", \"joinphrase\": \" & \"}, {\"name\": \"A2\"}], "
+      "\"releasegroups\": [{\"title\": \"G\", \"artists\": [{\"name\": \"GA\"}], "
+      "\"releases\": [{\"title\": \"R\", \"mediums\": [[], {\"tracks\": [{}]}]}]}], "
+      "\"duration\": 123.5, \"sources\": 3, \"title2\": null}, "
+      "{\"title\": \"T9\", \"artists\": [{\"name\": \"A9\"}]}]}, "
+      "{\"id\": \"b\", \"score\": 0.3}, "
+      "{\"id\": \"c\", \"score\": 0.2, \"recordings\": [{\"title\": \"T3\"}]}, "
+      "{\"id\": \"d\", \"recordings\": [{\"title\": \"T4\", \"artists\": [{\"name\": \"A4\"}]}], "
+      "\"score\": 1e-1, \"extra\": [true, false, null, -1.5E+2, {\"score\": 7}]}]}",
+      true, "A1|T1|0.90;A4|T4|0.10;" },
+    { "no results", 1, "{\"status\": \"ok\", \"results\": []}", true, "" },
+    { "batch order", 4,
+      "{\"status\": \"ok\", \"fingerprints\": ["
+      "{\"index\": 2, \"results\": [" + Result("A2", "T2", "0.2") + "]}, "
+      "{\"results\": [" + Result("A1", "T1", "0.1") + "]}, "
+      "{\"results\": [" + Result("A3", "T3", "0.3") + "], \"index\": \"0\"}, "
+      "{\"index\": 9, \"results\": [" + Result("A9", "T9", "0.9") + "]}, "
+      "{\"index\": 1.5, \"results\": [" + Result("A8", "T8", "0.8") + "]}, "
+      "{\"index\": 2, \"results\": [" + Result("A4", "T4", "0.4") + "]}]}",
+      true, "A3|T3|0.30;/A1|T1|0.10;/A2|T2|0.20;A4|T4|0.40;/" },
+    { "batch no fingerprints", 2, "{\"status\": \"ok\", \"results\": []}", false, "" },
+    { "error status", 1,
+      "{\"status\": \"error\", \"error\": {\"code\": 14, \"message\": \"rate\"}}", false, "" },
+    { "not an object", 1, "[{\"status\": \"ok\"}]", false, "" },
+    { "trailing data", 1, "{\"status\": \"ok\", \"results\": []} x", false, "" },
+    { "control character", 1, "{\"status\": \"ok\", \"results\": [\"a\x01\"]}", false, "" },
+    { "bad escape", 1, "{\"status\": \"ok\", \"results\": [\"\\x\"]}", false, "" },
+    { "empty", 1, "", false, "" },
+  };
+
+  // Every strict prefix of a valid response is incomplete
+  const std::string full = "{\"status\": \"ok\", \"fingerprints\": [{\"index\": 0, "
+    "\"results\": [" + Result("A\\u00e9", "T\\ud83c\\udfb5", "0.5") + "]}]}";
+  for (size_t size = 1; size < full.size(); ++size)
+  {
+    cases.push_back({ "truncated " + std::to_string(size), 2, full.substr(0, size), false, "" });
+  }
+
+  // Responses are accepted up to and including the size limit
+  const size_t maxSize = 16 * 1024 * 1024;
+  const std::string head = "{\"status\": \"ok\", \"pad\": \"";
+  const std::string tail = "\", \"results\": [" + Result("A", "T", "1") + "]}";
+  const std::string pad(maxSize - head.size() - tail.size(), 'x');
+  cases.push_back({ "at limit", 1, head + pad + tail, true, "A|T|1.00;" });
+  cases.push_back({ "above limit", 1, head + pad + "x" + tail, false, "" });
+
+  int failures = 0;
+  for (const auto& testCase : cases)
+  {
+    // Large bodies are fed in network sized chunks, others also byte by byte
+    const bool large = (testCase.body.size() > 65536);
+    const std::vector<size_t> chunkSizes = large ? std::vector<size_t>{ 16384 }
+                                                 : std::vector<size_t>{ 65536, 7, 1 };
+    for (size_t chunkSize : chunkSizes)
+    {
+      std::string matches;
+      const bool ok = Parse(testCase.count, testCase.body, chunkSize, matches);
+      if ((ok != testCase.ok) || (matches != testCase.expected))
+      {
+        printf("%s (chunk %zu)\nexpected %d %s\nactual   %d %s\n\n", testCase.name.c_str(),
+               chunkSize, testCase.ok, testCase.expected.c_str(), ok, matches.c_str());
+        ++failures;
+      }
+    }
+  }
+
+  if (failures > 0)
+  {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+
+  return 0;
+}